@@ -0,0 +1,213 @@
+#include "bandwidth_governor.h"
+
+#include <algorithm>
+
+TBandwidthGovernor::TTransfer::TTransfer(TBandwidthGovernor& governor, std::string host, const size_t weight)
+    : Governor(governor)
+    , Host(std::move(host))
+    , Weight(std::max<size_t>(weight, 1))
+{
+}
+
+TBandwidthGovernor::TTransfer::~TTransfer() {
+    Governor.Unregister(*this);
+}
+
+TBandwidthGovernor& TBandwidthGovernor::Instance() {
+    static TBandwidthGovernor governor;
+    return governor;
+}
+
+void TBandwidthGovernor::SetGlobalLimit(const size_t bytesPerSecond) {
+    std::unique_lock<std::mutex> lock(Mutex);
+    GlobalBucket.SetRate(bytesPerSecond, TClock::now());
+    Condition.notify_all();
+}
+
+void TBandwidthGovernor::SetHostLimit(const std::string& host, const size_t bytesPerSecond) {
+    std::unique_lock<std::mutex> lock(Mutex);
+    HostBuckets[host].SetRate(bytesPerSecond, TClock::now());
+    Condition.notify_all();
+}
+
+std::shared_ptr<TBandwidthGovernor::TTransfer> TBandwidthGovernor::Register(const std::string& host, const size_t weight) {
+    return std::make_shared<TTransfer>(*this, host, weight);
+}
+
+size_t TBandwidthGovernor::Acquire(TTransfer& transfer, const size_t bytes) {
+    if (bytes == 0) {
+        return 0;
+    }
+
+    std::unique_lock<std::mutex> lock(Mutex);
+    if (!IsLimited(transfer)) {
+        return bytes;
+    }
+
+    transfer.Requested += bytes;
+    if (transfer.WaitingCount++ == 0) {
+        Waiting.insert(&transfer);
+    }
+
+    while (true) {
+        const TClock::time_point now = TClock::now();
+        GlobalBucket.Refill(now);
+        for (auto& [host, bucket] : HostBuckets) {
+            bucket.Refill(now);
+        }
+
+        const size_t quantum = GetQuantum(transfer.Host);
+        const size_t wanted = std::min(bytes, quantum);
+        const size_t available = GetAvailable(transfer.Host);
+
+        if (SelectNext() == &transfer && available >= wanted) {
+            const size_t granted = std::min({bytes, quantum, available});
+
+            GlobalBucket.Take(granted);
+            if (TBucket* hostBucket = FindHostBucket(transfer.Host)) {
+                hostBucket->Take(granted);
+            }
+
+            VirtualTime = std::max(transfer.LastFinishTag, VirtualTime);
+            transfer.LastFinishTag = VirtualTime + granted / transfer.Weight;
+
+            transfer.Requested -= bytes;
+            if (--transfer.WaitingCount == 0) {
+                Waiting.erase(&transfer);
+            }
+
+            Condition.notify_all();
+
+            return granted;
+        }
+
+        // When every waiting transfer has stepped aside, nobody will wake the others
+        // up, so they wait for their own buckets to refill.
+        std::chrono::duration<double> waitTime = MaxWaitStep;
+        const TTransfer* next = SelectNext();
+        if (next == &transfer || !next) {
+            waitTime = std::chrono::duration<double>(0);
+            for (const TBucket* bucket : {&GlobalBucket, FindHostBucket(transfer.Host)}) {
+                if (bucket && bucket->IsLimited() && bucket->Tokens < wanted) {
+                    waitTime = std::max(waitTime, std::chrono::duration<double>((wanted - bucket->Tokens) / bucket->Rate));
+                }
+            }
+
+            waitTime = std::min<std::chrono::duration<double>>(waitTime, MaxWaitStep);
+        }
+
+        Condition.wait_for(lock, waitTime);
+    }
+}
+
+void TBandwidthGovernor::Refund(TTransfer& transfer, const size_t bytes) {
+    if (bytes == 0) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(Mutex);
+    GlobalBucket.Put(bytes);
+    if (TBucket* hostBucket = FindHostBucket(transfer.Host)) {
+        hostBucket->Put(bytes);
+    }
+
+    Condition.notify_all();
+}
+
+void TBandwidthGovernor::TBucket::SetRate(const size_t bytesPerSecond, const TClock::time_point now) {
+    Rate = bytesPerSecond;
+    Quantum = std::clamp<size_t>(bytesPerSecond / 10, MinQuantumBytes, MaxQuantumBytes);
+    Capacity = 2 * Quantum;
+    Tokens = Capacity;
+    LastRefill = now;
+}
+
+void TBandwidthGovernor::TBucket::Refill(const TClock::time_point now) {
+    if (!IsLimited()) {
+        return;
+    }
+
+    const std::chrono::duration<double> elapsed = now - LastRefill;
+    Tokens = std::min(Capacity, Tokens + elapsed.count() * Rate);
+    LastRefill = now;
+}
+
+void TBandwidthGovernor::TBucket::Take(const size_t bytes) {
+    if (IsLimited()) {
+        Tokens -= bytes;
+    }
+}
+
+void TBandwidthGovernor::TBucket::Put(const size_t bytes) {
+    if (IsLimited()) {
+        Tokens = std::min(Capacity, Tokens + bytes);
+    }
+}
+
+bool TBandwidthGovernor::TBucket::IsLimited() const {
+    return Rate > 0;
+}
+
+void TBandwidthGovernor::Unregister(TTransfer& transfer) {
+    std::unique_lock<std::mutex> lock(Mutex);
+    Waiting.erase(&transfer);
+    Condition.notify_all();
+}
+
+bool TBandwidthGovernor::IsLimited(const TTransfer& transfer) const {
+    if (GlobalBucket.IsLimited()) {
+        return true;
+    }
+
+    const std::unordered_map<std::string, TBucket>::const_iterator hostBucket = HostBuckets.find(transfer.Host);
+    return hostBucket != HostBuckets.end() && hostBucket->second.IsLimited();
+}
+
+TBandwidthGovernor::TBucket* TBandwidthGovernor::FindHostBucket(const std::string& host) {
+    const std::unordered_map<std::string, TBucket>::iterator hostBucket = HostBuckets.find(host);
+    if (hostBucket != HostBuckets.end() && hostBucket->second.IsLimited()) {
+        return &hostBucket->second;
+    }
+
+    return nullptr;
+}
+
+size_t TBandwidthGovernor::GetAvailable(const std::string& host) {
+    double available = GlobalBucket.IsLimited() ? GlobalBucket.Tokens : MaxQuantumBytes;
+    if (const TBucket* hostBucket = FindHostBucket(host)) {
+        available = std::min(available, hostBucket->Tokens);
+    }
+
+    return available > 0 ? static_cast<size_t>(available) : 0;
+}
+
+size_t TBandwidthGovernor::GetQuantum(const std::string& host) {
+    size_t quantum = GlobalBucket.IsLimited() ? GlobalBucket.Quantum : MaxQuantumBytes;
+    if (const TBucket* hostBucket = FindHostBucket(host)) {
+        quantum = std::min(quantum, hostBucket->Quantum);
+    }
+
+    return quantum;
+}
+
+TBandwidthGovernor::TTransfer* TBandwidthGovernor::SelectNext() {
+    // Transfers whose host has run out of tokens step aside, so the global
+    // bandwidth goes to the others instead of idling.
+    TTransfer* next = nullptr;
+    double nextStartTag = 0;
+
+    for (TTransfer* transfer : Waiting) {
+        const TBucket* hostBucket = FindHostBucket(transfer->Host);
+        if (hostBucket && hostBucket->Tokens < std::min(transfer->Requested, hostBucket->Quantum)) {
+            continue;
+        }
+
+        const double startTag = std::max(transfer->LastFinishTag, VirtualTime);
+        if (!next || startTag < nextStartTag) {
+            next = transfer;
+            nextStartTag = startTag;
+        }
+    }
+
+    return next;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+// Process-wide token bucket which shares the link between concurrent transfers.
+// Limits are applied to the global rate and to the rate of every host separately,
+// while waiting transfers are served in order of their weighted virtual time
+// (start-time fair queueing), so heavier transfers get proportionally more bytes.
+class TBandwidthGovernor {
+public:
+    class TTransfer {
+    public:
+        TTransfer(TBandwidthGovernor& governor, std::string host, const size_t weight);
+        ~TTransfer();
+
+    private:
+        friend class TBandwidthGovernor;
+
+        TBandwidthGovernor& Governor;
+        const std::string Host;
+        const double Weight;
+        double LastFinishTag = 0;
+        // Parallel connections of one download wait on the same transfer,
+        // so the requests of all of them are summed up.
+        size_t Requested = 0;
+        size_t WaitingCount = 0;
+    };
+
+public:
+    static TBandwidthGovernor& Instance();
+
+    // Zero means "unlimited".
+    void SetGlobalLimit(const size_t bytesPerSecond);
+    void SetHostLimit(const std::string& host, const size_t bytesPerSecond);
+
+    std::shared_ptr<TTransfer> Register(const std::string& host, const size_t weight = DefaultWeight);
+
+    // Blocks until the transfer is allowed to receive some bytes and returns
+    // how many of them (at least one, at most bytes).
+    size_t Acquire(TTransfer& transfer, const size_t bytes);
+    // Returns tokens which were acquired but not used.
+    void Refund(TTransfer& transfer, const size_t bytes);
+
+    static const size_t DefaultWeight = 1;
+
+private:
+    using TClock = std::chrono::steady_clock;
+
+    class TBucket {
+    public:
+        void SetRate(const size_t bytesPerSecond, const TClock::time_point now);
+        void Refill(const TClock::time_point now);
+        void Take(const size_t bytes);
+        void Put(const size_t bytes);
+        bool IsLimited() const;
+
+    public:
+        double Rate = 0;
+        double Tokens = 0;
+        double Capacity = 0;
+        size_t Quantum = MaxQuantumBytes;
+        TClock::time_point LastRefill;
+    };
+
+private:
+    void Unregister(TTransfer& transfer);
+
+    bool IsLimited(const TTransfer& transfer) const;
+    TBucket* FindHostBucket(const std::string& host);
+    size_t GetAvailable(const std::string& host);
+    size_t GetQuantum(const std::string& host);
+    TTransfer* SelectNext();
+
+private:
+    std::mutex Mutex;
+    std::condition_variable Condition;
+
+    TBucket GlobalBucket;
+    std::unordered_map<std::string, TBucket> HostBuckets;
+    std::unordered_set<TTransfer*> Waiting;
+    double VirtualTime = 0;
+
+    static const size_t MinQuantumBytes = 1024;
+    static const size_t MaxQuantumBytes = 64 * 1024;
+    static constexpr std::chrono::milliseconds MaxWaitStep = std::chrono::milliseconds(50);
+};
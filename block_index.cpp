@@ -0,0 +1,275 @@
+#include "block_index.h"
+#include "error.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <openssl/evp.h>
+#include <sstream>
+#include <unordered_map>
+
+const std::string TBlockIndex::Signature("lruc-index 1");
+
+static std::string EncodeHex(const std::string& data) {
+    static const char digits[] = "0123456789abcdef";
+
+    std::string result;
+    result.reserve(data.size() * 2);
+    for (const char symbol : data) {
+        result.push_back(digits[static_cast<unsigned char>(symbol) >> 4]);
+        result.push_back(digits[static_cast<unsigned char>(symbol) & 0xf]);
+    }
+
+    return result;
+}
+
+static std::string DecodeHex(const std::string& data) {
+    if (data.size() % 2 != 0) {
+        throw TError(data + " is not a hex string", false);
+    }
+
+    std::string result;
+    result.reserve(data.size() / 2);
+    for (size_t i = 0; i < data.size(); i += 2) {
+        unsigned int value = 0;
+        if (!std::isxdigit(static_cast<unsigned char>(data[i])) || !std::isxdigit(static_cast<unsigned char>(data[i + 1]))
+                || sscanf(data.c_str() + i, "%2x", &value) != 1) {
+            throw TError(data + " is not a hex string", false);
+        }
+
+        result.push_back(static_cast<char>(value));
+    }
+
+    return result;
+}
+
+TRollingChecksum::TRollingChecksum(const unsigned char* data, const size_t size)
+    : Size(size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        A += data[i];
+        B += (size - i) * data[i];
+    }
+}
+
+void TRollingChecksum::Roll(const unsigned char out, const unsigned char in) {
+    // The sums are taken modulo 2^16 when read, so wrapping around 2^32 does no harm.
+    A += in - out;
+    B += A - Size * out;
+}
+
+uint32_t TRollingChecksum::Get() const {
+    return (A & 0xffff) | (B << 16);
+}
+
+TBlockIndex TBlockIndex::Build(const std::string& path, const size_t blockSize) {
+    if (blockSize == 0) {
+        throw TError("Block size must be positive", false);
+    }
+
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        throw TError("Cannot open " + path, false);
+    }
+
+    TBlockIndex index;
+    index.BlockSize = blockSize;
+
+    std::string block(blockSize, '\0');
+    while (true) {
+        input.read(&block.front(), blockSize);
+        const size_t read = input.gcount();
+        if (read == 0) {
+            break;
+        }
+
+        std::fill(block.begin() + read, block.end(), '\0');
+
+        TBlock indexBlock;
+        indexBlock.Checksum = TRollingChecksum(reinterpret_cast<const unsigned char*>(block.data()), blockSize).Get();
+        indexBlock.Hash = ComputeHash(block.data(), blockSize);
+
+        index.Blocks.push_back(std::move(indexBlock));
+        index.Size += read;
+
+        if (read < blockSize) {
+            break;
+        }
+    }
+
+    if (input.bad()) {
+        throw TError("Cannot read " + path, false);
+    }
+
+    return index;
+}
+
+TBlockIndex TBlockIndex::Parse(const std::string& data) {
+    // lruc-index 1
+    // size <file size>
+    // block-size <block size>
+    // <rolling checksum> <SHA-256>
+    // ...
+    std::istringstream input(data);
+
+    std::string signature;
+    std::getline(input, signature);
+    if (signature != Signature) {
+        throw TError("Not a block index", false);
+    }
+
+    TBlockIndex index;
+    std::string sizeKey;
+    std::string blockSizeKey;
+    if (!(input >> sizeKey >> index.Size >> blockSizeKey >> index.BlockSize) || sizeKey != "size" || blockSizeKey != "block-size" || index.BlockSize == 0) {
+        throw TError("Block index is corrupted", false);
+    }
+
+    // Every block takes a line of the index, so a size beyond that is not worth allocating for.
+    const size_t blockCount = index.Size / index.BlockSize + (index.Size % index.BlockSize != 0 ? 1 : 0);
+    if (blockCount > data.size()) {
+        throw TError("Block index is corrupted", false);
+    }
+
+    index.Blocks.resize(blockCount);
+
+    for (TBlock& block : index.Blocks) {
+        std::string checksum;
+        std::string hash;
+        if (!(input >> checksum >> hash) || checksum.size() != 8 || hash.size() != 64) {
+            throw TError("Block index is corrupted", false);
+        }
+
+        try {
+            size_t checksumEnd = 0;
+            block.Checksum = std::stoul(checksum, &checksumEnd, 16);
+            if (checksumEnd != checksum.size() || !std::isxdigit(static_cast<unsigned char>(checksum.front()))) {
+                throw TError("Block index is corrupted", false);
+            }
+
+            block.Hash = DecodeHex(hash);
+        } catch (const std::exception&) {
+            throw TError("Block index is corrupted", false);
+        }
+    }
+
+    return index;
+}
+
+std::string TBlockIndex::Serialize() const {
+    std::string result;
+    {
+        result.append(Signature);
+        result.append("\nsize ");
+        result.append(std::to_string(Size));
+        result.append("\nblock-size ");
+        result.append(std::to_string(BlockSize));
+        result.append("\n");
+    }
+
+    for (const TBlock& block : Blocks) {
+        char checksum[9];
+        snprintf(checksum, sizeof(checksum), "%08x", block.Checksum);
+
+        result.append(checksum);
+        result.append(" ");
+        result.append(EncodeHex(block.Hash));
+        result.append("\n");
+    }
+
+    return result;
+}
+
+std::vector<std::optional<size_t>> TBlockIndex::FindBlocks(const char* data, const size_t size) const {
+    std::vector<std::optional<size_t>> result(Blocks.size());
+    if (Blocks.empty() || size == 0) {
+        return result;
+    }
+
+    std::unordered_map<uint32_t, std::vector<size_t>> blocksByChecksum;
+    for (size_t i = 0; i < Blocks.size(); ++i) {
+        blocksByChecksum[Blocks[i].Checksum].push_back(i);
+    }
+
+    // Windows which reach beyond the end are copied and padded, like the last block of the index.
+    std::string window(BlockSize, '\0');
+    const auto getWindow = [&](const size_t position) {
+        if (size - position >= BlockSize) {
+            return reinterpret_cast<const unsigned char*>(data + position);
+        }
+
+        std::copy(data + position, data + size, window.begin());
+        std::fill(window.begin() + (size - position), window.end(), '\0');
+        return reinterpret_cast<const unsigned char*>(window.data());
+    };
+
+    const auto getByte = [&](const size_t position) -> unsigned char {
+        return position < size ? data[position] : 0;
+    };
+
+    size_t blocksLeft = Blocks.size();
+    size_t position = 0;
+    TRollingChecksum checksum(getWindow(position), BlockSize);
+
+    while (position < size && blocksLeft > 0) {
+        bool isMatched = false;
+
+        // The strong hash is computed only for the rare windows whose checksum matches some block.
+        const std::unordered_map<uint32_t, std::vector<size_t>>::const_iterator candidates = blocksByChecksum.find(checksum.Get());
+        if (candidates != blocksByChecksum.end()) {
+            const std::string hash = ComputeHash(reinterpret_cast<const char*>(getWindow(position)), BlockSize);
+
+            // Equal blocks (runs of zeros, for example) are all taken from the same place.
+            for (const size_t block : candidates->second) {
+                if (!result[block] && Blocks[block].Hash == hash) {
+                    result[block] = position;
+                    --blocksLeft;
+                    isMatched = true;
+                }
+            }
+        }
+
+        if (isMatched) {
+            position += BlockSize;
+            if (position < size) {
+                checksum = TRollingChecksum(getWindow(position), BlockSize);
+            }
+        } else {
+            checksum.Roll(getByte(position), getByte(position + BlockSize));
+            ++position;
+        }
+    }
+
+    return result;
+}
+
+size_t TBlockIndex::GetBlockOffset(const size_t index) const {
+    return index * BlockSize;
+}
+
+size_t TBlockIndex::GetBlockDataSize(const size_t index) const {
+    return std::min(BlockSize, Size - GetBlockOffset(index));
+}
+
+bool TBlockIndex::CheckBlock(const size_t index, const char* data) const {
+    const size_t dataSize = GetBlockDataSize(index);
+    if (dataSize == BlockSize) {
+        return ComputeHash(data, dataSize) == Blocks[index].Hash;
+    }
+
+    std::string block(data, dataSize);
+    block.resize(BlockSize, '\0');
+
+    return ComputeHash(block.data(), block.size()) == Blocks[index].Hash;
+}
+
+std::string TBlockIndex::ComputeHash(const char* data, const size_t size) {
+    unsigned char hash[EVP_MAX_MD_SIZE];
+    unsigned int hashSize = 0;
+    if (EVP_Digest(data, size, hash, &hashSize, EVP_sha256(), nullptr) != 1) {
+        throw TError("Cannot compute SHA-256", false);
+    }
+
+    return std::string(reinterpret_cast<const char*>(hash), hashSize);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Sum of the bytes and sum of the running sums over a window (as in rsync),
+// which is updated in constant time when the window moves by one byte.
+class TRollingChecksum {
+public:
+    TRollingChecksum(const unsigned char* data, const size_t size);
+
+    void Roll(const unsigned char out, const unsigned char in);
+    uint32_t Get() const;
+
+private:
+    size_t Size = 0;
+    uint32_t A = 0;
+    uint32_t B = 0;
+};
+
+// Checksums of fixed-size blocks of a file, published next to the file so that
+// a client with an older copy can tell which blocks it already has.
+// The last block is padded with zeros.
+class TBlockIndex {
+public:
+    class TBlock {
+    public:
+        uint32_t Checksum = 0;
+        // SHA-256.
+        std::string Hash;
+    };
+
+public:
+    static TBlockIndex Build(const std::string& path, const size_t blockSize = DefaultBlockSizeBytes);
+
+    static TBlockIndex Parse(const std::string& data);
+    std::string Serialize() const;
+
+    // Looks for every block at any offset of the data; the result holds
+    // the offset of each block found. Data beyond the end reads as zeros.
+    std::vector<std::optional<size_t>> FindBlocks(const char* data, const size_t size) const;
+
+    size_t GetBlockOffset(const size_t index) const;
+    // Real size of the block, without the padding.
+    size_t GetBlockDataSize(const size_t index) const;
+
+    // Checks GetBlockDataSize(index) bytes of data against the hash of the block.
+    bool CheckBlock(const size_t index, const char* data) const;
+
+    static std::string ComputeHash(const char* data, const size_t size);
+
+public:
+    size_t Size = 0;
+    size_t BlockSize = DefaultBlockSizeBytes;
+    std::vector<TBlock> Blocks;
+
+    static const size_t DefaultBlockSizeBytes = 16 * 1024;
+
+private:
+    static const std::string Signature;
+};
@@ -0,0 +1,629 @@
+#include "download_service.h"
+#include "error.h"
+#include "memory_budget.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <signal.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#ifdef MSG_NOSIGNAL
+static const int SendFlags = MSG_NOSIGNAL;
+#else
+static const int SendFlags = 0;
+#endif
+
+const std::string TDownloadService::TemporarySuffix(".part");
+const std::string TDownloadService::MetricsTarget("metrics");
+
+TDownloadService::TDownloadService(const std::string& socketPath, const std::string& cacheDirectory, const TDownloadOptions& options)
+    : SocketPath(socketPath)
+    , CacheDirectory(cacheDirectory)
+    , Options(options)
+{
+    if (mkdir(CacheDirectory.c_str(), 0777) == -1 && errno != EEXIST) {
+        throw TError("Cannot create cache directory " + CacheDirectory, false);
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (SocketPath.size() >= sizeof(address.sun_path)) {
+        throw TError(SocketPath + " is too long for a socket path", false);
+    }
+
+    memcpy(address.sun_path, SocketPath.data(), SocketPath.size());
+
+    ListenDescriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (ListenDescriptor == -1) {
+        throw TError("Cannot create socket", false);
+    }
+
+    // A socket left by the previous run would make bind fail.
+    unlink(SocketPath.c_str());
+
+    if (bind(ListenDescriptor, reinterpret_cast<const struct sockaddr*>(&address), sizeof(address)) == -1
+            || listen(ListenDescriptor, ListenBacklog) == -1) {
+        close(ListenDescriptor);
+        throw TError("Cannot listen on " + SocketPath, false);
+    }
+}
+
+TDownloadService::~TDownloadService() {
+    close(ListenDescriptor);
+    unlink(SocketPath.c_str());
+}
+
+void TDownloadService::Run() {
+    // Clients which go away must not kill the service.
+    signal(SIGPIPE, SIG_IGN);
+
+    while (true) {
+        // Clients above the limit wait in the listen backlog.
+        {
+            std::unique_lock<std::mutex> lock(ClientMutex);
+            ClientCondition.wait(lock, [this]() {
+                return ClientCount < MaxClientCount;
+            });
+        }
+
+        const int descriptor = accept(ListenDescriptor, nullptr, nullptr);
+        if (descriptor == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+
+            // Out of descriptors or memory: accept fails right away until clients finish.
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                std::this_thread::sleep_for(AcceptRetryDelay);
+                continue;
+            }
+
+            throw TError("Cannot accept connection", false);
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(ClientMutex);
+            ++ClientCount;
+        }
+
+        std::thread(&TDownloadService::ServeClient, this, descriptor).detach();
+    }
+}
+
+void TDownloadService::ServeClient(const int descriptor) {
+    const std::chrono::milliseconds timeout = Options.Connection.OperationTimeout;
+    if (timeout > std::chrono::milliseconds::zero()) {
+        struct timeval value;
+        {
+            value.tv_sec = timeout.count() / 1000;
+            value.tv_usec = (timeout.count() % 1000) * 1000;
+        }
+
+        setsockopt(descriptor, SOL_SOCKET, SO_RCVTIMEO, &value, sizeof(value));
+        setsockopt(descriptor, SOL_SOCKET, SO_SNDTIMEO, &value, sizeof(value));
+    }
+
+    try {
+        const std::optional<TClientRequest> request = ReceiveRequest(descriptor);
+        if (!request) {
+            SendHead(descriptor, 400, "Bad Request", 0);
+        } else if (request->Target == MetricsTarget) {
+            SendMetrics(descriptor);
+        } else if (!IsUpstreamUrlAllowed(request->Target)) {
+            SendHead(descriptor, 400, "Bad Request", 0);
+        } else {
+            const std::string& url = request->Target;
+            const std::string cachePath = GetCachePath(url);
+
+            int fileDescriptor = -1;
+            std::shared_ptr<TFlight> flight;
+            try {
+                flight = JoinFlight(*request, cachePath, fileDescriptor);
+            } catch (const TError&) {
+                SendHead(descriptor, 400, "Bad Request", 0);
+                throw;
+            }
+
+            if (flight) {
+                SendFromFlight(descriptor, *request, *flight);
+            } else {
+                try {
+                    SendCached(descriptor, *request, fileDescriptor, MakeCacheHeader(url).size());
+                } catch (...) {
+                    close(fileDescriptor);
+                    throw;
+                }
+
+                close(fileDescriptor);
+            }
+        }
+    } catch (...) {
+        // Closing the connection before the whole body is sent tells the client that the transfer has failed.
+    }
+
+    close(descriptor);
+
+    std::unique_lock<std::mutex> lock(ClientMutex);
+    --ClientCount;
+    ClientCondition.notify_one();
+}
+
+std::shared_ptr<TDownloadService::TFlight> TDownloadService::JoinFlight(
+        const TClientRequest& request,
+        const std::string& cachePath,
+        int& cachedFileDescriptor) {
+    const std::string& url = request.Target;
+
+    std::unique_lock<std::mutex> lock(Mutex);
+
+    const std::map<std::string, std::shared_ptr<TFlight>>::iterator flight = Flights.find(url);
+    if (flight != Flights.end()) {
+        return flight->second;
+    }
+
+    // A finished flight leaves the map only after its file is in place, so checking under the lock misses nothing.
+    // A file of another URL with the same hash is replaced when the new flight is over.
+    const std::string header = MakeCacheHeader(url);
+    cachedFileDescriptor = open(cachePath.c_str(), O_RDONLY);
+    if (cachedFileDescriptor != -1) {
+        if (HasCacheHeader(cachedFileDescriptor, header)) {
+            return std::shared_ptr<TFlight>();
+        }
+
+        close(cachedFileDescriptor);
+        cachedFileDescriptor = -1;
+    }
+
+    // Flights of URLs with the same hash do not share the temporary file.
+    const std::string temporaryPath = cachePath + "." + std::to_string(NextFlightId++) + TemporarySuffix;
+
+    TDownloadOptions options = Options;
+    options.Priority = request.Priority;
+
+    std::unique_ptr<THttpFileDownloader> downloader = std::make_unique<THttpFileDownloader>(url, options);
+    std::shared_ptr<TFlight> newFlight = std::make_shared<TFlight>(temporaryPath, header);
+    Flights.emplace(url, newFlight);
+
+    std::thread(&TDownloadService::RunFlight, this, url, cachePath, temporaryPath, std::move(downloader), newFlight).detach();
+
+    return newFlight;
+}
+
+void TDownloadService::RunFlight(
+        const std::string url,
+        const std::string cachePath,
+        const std::string temporaryPath,
+        std::unique_ptr<THttpFileDownloader> downloader,
+        std::shared_ptr<TFlight> flight) {
+    std::exception_ptr error;
+    try {
+        downloader->Download(*flight);
+        flight->Close();
+
+        if (rename(temporaryPath.c_str(), cachePath.c_str()) == -1) {
+            throw TError("Cannot move " + temporaryPath + " to the cache", false);
+        }
+    } catch (...) {
+        error = std::current_exception();
+
+        // Clients which are still reading keep the file open.
+        unlink(temporaryPath.c_str());
+    }
+
+    flight->Finish(error);
+
+    std::unique_lock<std::mutex> lock(Mutex);
+    Flights.erase(url);
+}
+
+void TDownloadService::SendCached(const int descriptor, const TClientRequest& request, const int fileDescriptor, const size_t dataOffset) {
+    struct stat fileStat;
+    if (fstat(fileDescriptor, &fileStat) == -1 || static_cast<size_t>(fileStat.st_size) < dataOffset) {
+        throw TError("Cannot stat cached file", false);
+    }
+
+    size_t first = 0;
+    size_t count = 0;
+    if (SendContentHead(descriptor, request, fileStat.st_size - dataOffset, first, count)) {
+        SendFileRange(descriptor, fileDescriptor, dataOffset + first, count);
+    }
+}
+
+void TDownloadService::SendFromFlight(const int descriptor, const TClientRequest& request, TFlight& flight) {
+    const std::optional<size_t> size = flight.WaitForSize();
+    if (!size) {
+        SendHead(descriptor, 502, "Bad Gateway", 0);
+        return;
+    }
+
+    size_t first = 0;
+    size_t count = 0;
+    if (!SendContentHead(descriptor, request, *size, first, count)) {
+        return;
+    }
+
+    // A range ahead of what is written yet waits for the leading bytes to get there.
+    size_t sent = first;
+    while (sent < first + count) {
+        const size_t available = std::min(flight.WaitForData(sent), first + count);
+        SendFileRange(descriptor, flight.GetReadDescriptor(), flight.GetDataOffset() + sent, available - sent);
+        sent = available;
+    }
+}
+
+bool TDownloadService::SendContentHead(const int descriptor, const TClientRequest& request, const size_t size, size_t& first, size_t& count) {
+    first = 0;
+    count = size;
+
+    if (!request.Range) {
+        SendHead(descriptor, 200, "OK", size, "Accept-Ranges: bytes\r\n");
+        return true;
+    }
+
+    if (request.Range->first >= size) {
+        SendHead(descriptor, 416, "Range Not Satisfiable", 0, "Content-Range: bytes */" + std::to_string(size) + "\r\n");
+        return false;
+    }
+
+    first = request.Range->first;
+    const size_t last = std::min(request.Range->second.value_or(size - 1), size - 1);
+    count = last - first + 1;
+
+    SendHead(
+            descriptor,
+            206,
+            "Partial Content",
+            count,
+            "Content-Range: bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" + std::to_string(size) + "\r\n");
+    return true;
+}
+
+void TDownloadService::SendMetrics(const int descriptor) {
+    const TMemoryBudget& budget = TMemoryBudget::Instance();
+
+    std::string metrics;
+    metrics += "memory_usage_bytes " + std::to_string(budget.GetUsage()) + "\n";
+    metrics += "memory_peak_usage_bytes " + std::to_string(budget.GetPeakUsage()) + "\n";
+    metrics += "memory_limit_bytes " + std::to_string(budget.GetLimit()) + "\n";
+
+    const std::shared_ptr<TTlsContext> context = Options.Connection.TlsContext ? Options.Connection.TlsContext : TTlsContext::GetDefault();
+    metrics += "tls_handshakes " + std::to_string(context->GetHandshakeCount()) + "\n";
+    metrics += "tls_resumed_handshakes " + std::to_string(context->GetResumedHandshakeCount()) + "\n";
+    metrics += "tls_ktls_connections " + std::to_string(context->GetKernelTlsCount()) + "\n";
+
+    SendHead(descriptor, 200, "OK", metrics.size());
+    SendAll(descriptor, metrics);
+}
+
+std::optional<TDownloadService::TClientRequest> TDownloadService::ReceiveRequest(const int descriptor) {
+    std::string head;
+    size_t headEnd = std::string::npos;
+
+    while (headEnd == std::string::npos) {
+        if (head.size() >= MaxRequestHeadSizeBytes) {
+            return std::nullopt;
+        }
+
+        char buffer[4096];
+        const ssize_t received = recv(descriptor, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            throw TError("Cannot receive request", false);
+        }
+
+        const size_t searchStart = head.size() >= 3 ? head.size() - 3 : 0;
+        head.append(buffer, received);
+        headEnd = head.find("\r\n\r\n", searchStart);
+    }
+
+    // GET <target> HTTP/1.1
+    const size_t lineEnd = head.find("\r\n");
+    const std::string_view line(head.data(), lineEnd);
+
+    const size_t targetStart = line.find(' ');
+    const size_t targetEnd = line.rfind(' ');
+    if (line.substr(0, targetStart) != "GET" || targetEnd == targetStart || line.compare(targetEnd + 1, 5, "HTTP/") != 0) {
+        return std::nullopt;
+    }
+
+    std::string_view target = line.substr(targetStart + 1, targetEnd - targetStart - 1);
+    if (!target.empty() && target.front() == '/') {
+        target.remove_prefix(1);
+    }
+
+    TClientRequest request;
+    request.Target = std::string(target);
+
+    // <name>: <value>
+    size_t headerStart = lineEnd + 2;
+    while (headerStart < headEnd) {
+        const size_t headerEnd = head.find("\r\n", headerStart);
+        const std::string_view header(head.data() + headerStart, headerEnd - headerStart);
+        headerStart = headerEnd + 2;
+
+        const size_t separator = header.find(':');
+        if (separator == std::string_view::npos) {
+            continue;
+        }
+
+        std::string_view value = header.substr(separator + 1);
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+            value.remove_prefix(1);
+        }
+
+        if (separator == 5 && strncasecmp(header.data(), "Range", separator) == 0) {
+            request.Range = ParseRange(value);
+        } else if (separator == 10 && strncasecmp(header.data(), "X-Priority", separator) == 0) {
+            request.Priority = ParsePriority(value).value_or(TBandwidthGovernor::DefaultWeight);
+        }
+    }
+
+    return request;
+}
+
+std::optional<std::pair<size_t, std::optional<size_t>>> TDownloadService::ParseRange(const std::string_view& value) {
+    // bytes=<first>-[<last>]
+    const std::string_view prefix = "bytes=";
+    if (value.compare(0, prefix.size(), prefix) != 0) {
+        return std::nullopt;
+    }
+
+    const std::string_view range = value.substr(prefix.size());
+    const size_t dash = range.find('-');
+    if (dash == 0 || dash == std::string_view::npos) {
+        return std::nullopt;
+    }
+
+    const auto parseNumber = [](const std::string_view& text, size_t& number) {
+        const std::from_chars_result result = std::from_chars(text.data(), text.data() + text.size(), number);
+        return !text.empty() && result.ec == std::errc() && result.ptr == text.data() + text.size();
+    };
+
+    size_t first = 0;
+    if (!parseNumber(range.substr(0, dash), first)) {
+        return std::nullopt;
+    }
+
+    const std::string_view lastText = range.substr(dash + 1);
+    if (lastText.empty()) {
+        return std::make_pair(first, std::optional<size_t>());
+    }
+
+    size_t last = 0;
+    if (!parseNumber(lastText, last) || last < first) {
+        return std::nullopt;
+    }
+
+    return std::make_pair(first, std::optional<size_t>(last));
+}
+
+std::optional<size_t> TDownloadService::ParsePriority(const std::string_view& value) {
+    size_t priority = 0;
+    const std::from_chars_result result = std::from_chars(value.data(), value.data() + value.size(), priority);
+    if (value.empty() || result.ec != std::errc() || result.ptr != value.data() + value.size() || priority == 0) {
+        return std::nullopt;
+    }
+
+    return priority;
+}
+
+bool TDownloadService::IsUpstreamUrlAllowed(const std::string& url) {
+    // http+unix:// would let any local client reach sockets (docker.sock for example) with the rights of the service.
+    return url.compare(0, 7, "http://") == 0 || url.compare(0, 8, "https://") == 0;
+}
+
+std::string TDownloadService::GetCachePath(const std::string& url) const {
+    // FNV-1a is enough to tell URLs apart and is the same in every build.
+    uint64_t hash = 14695981039346656037ull;
+    for (const char symbol : url) {
+        hash ^= static_cast<unsigned char>(symbol);
+        hash *= 1099511628211ull;
+    }
+
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+
+    return CacheDirectory + "/" + name;
+}
+
+std::string TDownloadService::MakeCacheHeader(const std::string& url) {
+    return std::to_string(url.size()) + "\n" + url + "\n";
+}
+
+bool TDownloadService::HasCacheHeader(const int fileDescriptor, const std::string& header) {
+    std::string data(header.size(), '\0');
+
+    size_t totalRead = 0;
+    while (totalRead < data.size()) {
+        const ssize_t bytesRead = pread(fileDescriptor, &data[totalRead], data.size() - totalRead, totalRead);
+        if (bytesRead < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (bytesRead <= 0) {
+            return false;
+        }
+
+        totalRead += bytesRead;
+    }
+
+    return data == header;
+}
+
+void TDownloadService::SendHead(
+        const int descriptor,
+        const int statusCode,
+        const std::string& statusText,
+        const size_t contentLength,
+        const std::string& headers) {
+    std::string head;
+    {
+        head.append("HTTP/1.1 ");
+        head.append(std::to_string(statusCode));
+        head.append(" ");
+        head.append(statusText);
+        head.append("\r\nContent-Length: ");
+        head.append(std::to_string(contentLength));
+        head.append("\r\n");
+        head.append(headers);
+        head.append("Connection: close\r\n\r\n");
+    }
+
+    SendAll(descriptor, head);
+}
+
+void TDownloadService::SendAll(const int descriptor, const std::string_view& data) {
+    size_t totalBytesSended = 0;
+    while (totalBytesSended < data.size()) {
+        const ssize_t bytesSended = send(descriptor, data.data() + totalBytesSended, data.size() - totalBytesSended, SendFlags);
+        if (bytesSended < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            throw TError("Cannot send data", false);
+        }
+
+        totalBytesSended += bytesSended;
+    }
+}
+
+void TDownloadService::SendFileRange(const int descriptor, const int fileDescriptor, size_t offset, size_t size) {
+#ifdef __linux__
+    // The file is sent straight from the page cache.
+    while (size > 0) {
+        off_t fileOffset = offset;
+        const ssize_t bytesSended = sendfile(descriptor, fileDescriptor, &fileOffset, std::min(size, SendChunkSizeBytes));
+        if (bytesSended <= 0) {
+            if (bytesSended < 0 && errno == EINTR) {
+                continue;
+            }
+
+            throw TError("Cannot send data", false);
+        }
+
+        offset += bytesSended;
+        size -= bytesSended;
+    }
+#else
+    std::string buffer(std::min(size, SendChunkSizeBytes), '\0');
+    while (size > 0) {
+        const ssize_t bytesRead = pread(fileDescriptor, &buffer.front(), std::min(size, buffer.size()), offset);
+        if (bytesRead <= 0) {
+            if (bytesRead < 0 && errno == EINTR) {
+                continue;
+            }
+
+            throw TError("Cannot read cached file", false);
+        }
+
+        SendAll(descriptor, std::string_view(buffer.data(), bytesRead));
+
+        offset += bytesRead;
+        size -= bytesRead;
+    }
+#endif
+}
+
+TDownloadService::TFlight::TFlight(const std::string& path, const std::string& header)
+    : Sink(path)
+    , DataOffset(header.size())
+{
+    Sink.WriteAt(0, header);
+
+    ReadDescriptor = open(path.c_str(), O_RDONLY);
+    if (ReadDescriptor == -1) {
+        throw TError("Cannot open " + path, false);
+    }
+}
+
+TDownloadService::TFlight::~TFlight() {
+    close(ReadDescriptor);
+}
+
+void TDownloadService::TFlight::Allocate(const size_t size) {
+    Sink.Allocate(DataOffset + size);
+
+    std::unique_lock<std::mutex> lock(Mutex);
+    Size = size;
+    Condition.notify_all();
+}
+
+void TDownloadService::TFlight::WriteAt(const size_t offset, const std::string_view& data) {
+    Sink.WriteAt(DataOffset + offset, data);
+
+    std::unique_lock<std::mutex> lock(Mutex);
+
+    size_t& end = Written[offset];
+    end = std::max(end, offset + data.size());
+
+    // Parts may be written out of order by parallel connections, clients are sent only the leading part without gaps.
+    std::map<size_t, size_t>::iterator part = Written.begin();
+    while (part != Written.end() && part->first <= Available) {
+        Available = std::max(Available, part->second);
+        part = Written.erase(part);
+    }
+
+    Condition.notify_all();
+}
+
+void TDownloadService::TFlight::Close() {
+    Sink.Close();
+}
+
+void TDownloadService::TFlight::Finish(std::exception_ptr error) {
+    std::unique_lock<std::mutex> lock(Mutex);
+    IsFinished = true;
+    Error = error;
+    Condition.notify_all();
+}
+
+std::optional<size_t> TDownloadService::TFlight::WaitForSize() {
+    std::unique_lock<std::mutex> lock(Mutex);
+    Condition.wait(lock, [this]() {
+        return Size || IsFinished;
+    });
+
+    return Size;
+}
+
+size_t TDownloadService::TFlight::WaitForData(const size_t offset) {
+    std::unique_lock<std::mutex> lock(Mutex);
+    Condition.wait(lock, [this, offset]() {
+        return Available > offset || IsFinished;
+    });
+
+    if (Available > offset) {
+        return Available;
+    }
+
+    if (Error) {
+        std::rethrow_exception(Error);
+    }
+
+    throw TError("Transfer is over", false);
+}
+
+int TDownloadService::TFlight::GetReadDescriptor() const {
+    return ReadDescriptor;
+}
+
+size_t TDownloadService::TFlight::GetDataOffset() const {
+    return DataOffset;
+}
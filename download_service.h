@@ -0,0 +1,147 @@
+#pragma once
+
+#include "file_sink.h"
+#include "http_file_downloader.h"
+#include "output_sink.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Long-running local service which downloads on behalf of other processes.
+// A client asks for GET /<url> (or GET <url>) over a Unix domain socket:
+//
+//     lruc "http+unix://%2Frun%2Flruc.sock/http://host/file" output
+//
+// Downloads are kept in the cache directory, every file starts with the URL it
+// holds. Concurrent requests for the same URL share a single upstream transfer,
+// and every client is sent the bytes as soon as they are written to the cache.
+class TDownloadService {
+public:
+    TDownloadService(const std::string& socketPath, const std::string& cacheDirectory, const TDownloadOptions& options);
+    ~TDownloadService();
+
+    // Serves clients forever.
+    void Run();
+
+private:
+    // Single upstream transfer into the cache, which clients read while it is written.
+    class TFlight : public TOutputSink {
+    public:
+        // The header is written before the content.
+        TFlight(const std::string& path, const std::string& header);
+        virtual ~TFlight() override;
+
+        virtual void Allocate(const size_t size) override;
+        virtual void WriteAt(const size_t offset, const std::string_view& data) override;
+        virtual void Close() override;
+
+        void Finish(std::exception_ptr error);
+
+        // Empty result means the transfer failed before the size was known.
+        std::optional<size_t> WaitForSize();
+        // Returns how many leading bytes are in the file, more than offset; throws when the transfer failed.
+        size_t WaitForData(const size_t offset);
+
+        int GetReadDescriptor() const;
+        // Where the content starts in the file.
+        size_t GetDataOffset() const;
+
+    private:
+        TFileSink Sink;
+        int ReadDescriptor = -1;
+        const size_t DataOffset;
+
+        std::mutex Mutex;
+        std::condition_variable Condition;
+
+        std::optional<size_t> Size;
+        // Leading bytes written without gaps; parts written ahead of them are kept in Written.
+        size_t Available = 0;
+        std::map<size_t, size_t> Written;
+
+        bool IsFinished = false;
+        std::exception_ptr Error;
+    };
+
+    class TClientRequest {
+    public:
+        std::string Target;
+        // "Range: bytes=<first>-[<last>]", other forms are ignored and the whole content is sent.
+        std::optional<std::pair<size_t, std::optional<size_t>>> Range;
+        // "X-Priority: <weight>", the share of the limited bandwidth of the flight the request starts.
+        size_t Priority = TBandwidthGovernor::DefaultWeight;
+    };
+
+private:
+    void ServeClient(const int descriptor);
+
+    // Returns the transfer of the URL, a new or a running one. Empty result means the
+    // URL is already in the cache, and cachedFileDescriptor is the opened file.
+    // A new transfer is weighted by the priority of the request, a running one keeps its own.
+    std::shared_ptr<TFlight> JoinFlight(const TClientRequest& request, const std::string& cachePath, int& cachedFileDescriptor);
+    void RunFlight(
+            const std::string url,
+            const std::string cachePath,
+            const std::string temporaryPath,
+            std::unique_ptr<THttpFileDownloader> downloader,
+            std::shared_ptr<TFlight> flight);
+
+    void SendCached(const int descriptor, const TClientRequest& request, const int fileDescriptor, const size_t dataOffset);
+    void SendFromFlight(const int descriptor, const TClientRequest& request, TFlight& flight);
+    // Answers 200, or 206 for the requested range of the content. Returns false when the range
+    // is not satisfiable and 416 is sent, otherwise the part of the content to send.
+    bool SendContentHead(const int descriptor, const TClientRequest& request, const size_t size, size_t& first, size_t& count);
+    // Memory budget usage and TLS counters as "name value" lines, for GET /metrics.
+    void SendMetrics(const int descriptor);
+
+    // Empty result means a malformed request.
+    std::optional<TClientRequest> ReceiveRequest(const int descriptor);
+    std::string GetCachePath(const std::string& url) const;
+    // Only network URLs are fetched on behalf of clients.
+    static bool IsUpstreamUrlAllowed(const std::string& url);
+    // Cache files are named by a hash of the URL, the header tells URLs with the same hash apart.
+    static std::string MakeCacheHeader(const std::string& url);
+    static bool HasCacheHeader(const int fileDescriptor, const std::string& header);
+    static std::optional<std::pair<size_t, std::optional<size_t>>> ParseRange(const std::string_view& value);
+    static std::optional<size_t> ParsePriority(const std::string_view& value);
+    // Extra headers are "<name>: <value>\r\n" lines.
+    static void SendHead(
+            const int descriptor,
+            const int statusCode,
+            const std::string& statusText,
+            const size_t contentLength,
+            const std::string& headers = std::string());
+    static void SendAll(const int descriptor, const std::string_view& data);
+    static void SendFileRange(const int descriptor, const int fileDescriptor, size_t offset, size_t size);
+
+private:
+    const std::string SocketPath;
+    const std::string CacheDirectory;
+    const TDownloadOptions Options;
+
+    int ListenDescriptor = -1;
+
+    std::mutex Mutex;
+    std::map<std::string, std::shared_ptr<TFlight>> Flights;
+    size_t NextFlightId = 0;
+
+    std::mutex ClientMutex;
+    std::condition_variable ClientCondition;
+    size_t ClientCount = 0;
+
+    static const std::string TemporarySuffix;
+    static const std::string MetricsTarget;
+    static const size_t MaxRequestHeadSizeBytes = 64 * 1024;
+    static const size_t SendChunkSizeBytes = 1 * 1024 * 1024;
+    static const int ListenBacklog = 128;
+    static const size_t MaxClientCount = 256;
+    static constexpr std::chrono::milliseconds AcceptRetryDelay = std::chrono::milliseconds(100);
+};
@@ -0,0 +1,214 @@
+#include "file_sink.h"
+#include "error.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+TFileSink::TFileSink(const std::string& path, const bool useDirectIo) {
+    Descriptor = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (Descriptor == -1) {
+        throw TError("Unable to open file " + path, false);
+    }
+
+#ifdef __linux__
+    if (useDirectIo) {
+        // Filesystems without O_DIRECT support (tmpfs for example) refuse to open
+        // the file, then the data simply goes through the page cache. So does it
+        // when the memory budget has no room for the buffer: it would be held for
+        // the whole download while the download waits for memory of its own.
+        DirectDescriptor = open(path.c_str(), O_WRONLY | O_DIRECT);
+        if (DirectDescriptor != -1 && !TMemoryBudget::Instance().TryAcquire(DirectBufferSizeBytes, DirectBufferLease)) {
+            close(DirectDescriptor);
+            DirectDescriptor = -1;
+        }
+
+        if (DirectDescriptor != -1) {
+            void* buffer = nullptr;
+            if (posix_memalign(&buffer, DirectIoAlignmentBytes, DirectBufferSizeBytes) != 0) {
+                close(DirectDescriptor);
+                close(Descriptor);
+                throw TError("Unable to allocate aligned buffer", false);
+            }
+
+            DirectBuffer = static_cast<char*>(buffer);
+        }
+    }
+#endif
+}
+
+TFileSink::~TFileSink() {
+    if (DirectDescriptor != -1) {
+        close(DirectDescriptor);
+    }
+
+    if (Descriptor != -1) {
+        close(Descriptor);
+    }
+
+    free(DirectBuffer);
+}
+
+void TFileSink::Allocate(const size_t size) {
+    std::unique_lock<std::mutex> lock(Mutex);
+    CheckIsOpened();
+
+#ifdef __linux__
+    if (size == 0) {
+        return;
+    }
+
+    // Reserving the whole file at once keeps it contiguous on disk. The size is kept
+    // as is, so an interrupted download does not look complete. Filesystems without
+    // fallocate support are fine, only running out of space matters.
+    if (fallocate(Descriptor, FALLOC_FL_KEEP_SIZE, 0, size) == -1 && errno == ENOSPC) {
+        throw TError("Not enough space to write file", false);
+    }
+#endif
+}
+
+void TFileSink::WriteAt(const size_t offset, const std::string_view& data) {
+    std::unique_lock<std::mutex> lock(Mutex);
+    CheckIsOpened();
+
+    if (DirectDescriptor != -1) {
+        WriteDirect(offset, data);
+    } else {
+        WriteBuffered(Descriptor, offset, data);
+        WriteBehind(offset, data.size());
+    }
+}
+
+void TFileSink::Close() {
+    std::unique_lock<std::mutex> lock(Mutex);
+    CheckIsOpened();
+
+    if (DirectDescriptor != -1) {
+        FlushDirectBuffer();
+
+        close(DirectDescriptor);
+        DirectDescriptor = -1;
+    }
+
+    // The last window stays in the page cache: it is already being written back
+    // and is the part of the file most likely to be read right away.
+    WrittenRegions.clear();
+    WrittenRegionsSize = 0;
+
+    const int closeResult = close(Descriptor);
+    Descriptor = -1;
+
+    if (closeResult == -1) {
+        throw TError("Unable to write to file", false);
+    }
+}
+
+void TFileSink::WriteDirect(size_t offset, std::string_view data) {
+    if (DirectBufferUsed > 0 && offset != DirectBufferOffset + DirectBufferUsed) {
+        FlushDirectBuffer();
+    }
+
+    if (DirectBufferUsed == 0) {
+        // O_DIRECT needs aligned file offsets, so the unaligned head goes through the page cache.
+        const size_t misalignment = offset % DirectIoAlignmentBytes;
+        if (misalignment != 0) {
+            const size_t headSize = std::min(data.size(), DirectIoAlignmentBytes - misalignment);
+            WriteBuffered(Descriptor, offset, data.substr(0, headSize));
+
+            offset += headSize;
+            data.remove_prefix(headSize);
+        }
+
+        DirectBufferOffset = offset;
+    }
+
+    while (!data.empty()) {
+        const size_t copySize = std::min(data.size(), DirectBufferSizeBytes - DirectBufferUsed);
+        memcpy(DirectBuffer + DirectBufferUsed, data.data(), copySize);
+
+        DirectBufferUsed += copySize;
+        data.remove_prefix(copySize);
+
+        if (DirectBufferUsed == DirectBufferSizeBytes) {
+            WriteBuffered(DirectDescriptor, DirectBufferOffset, std::string_view(DirectBuffer, DirectBufferUsed));
+
+            DirectBufferOffset += DirectBufferUsed;
+            DirectBufferUsed = 0;
+        }
+    }
+}
+
+void TFileSink::FlushDirectBuffer() {
+    const size_t alignedSize = DirectBufferUsed - DirectBufferUsed % DirectIoAlignmentBytes;
+    if (alignedSize > 0) {
+        WriteBuffered(DirectDescriptor, DirectBufferOffset, std::string_view(DirectBuffer, alignedSize));
+    }
+
+    // The unaligned tail cannot be written with O_DIRECT.
+    if (alignedSize < DirectBufferUsed) {
+        WriteBuffered(
+                Descriptor,
+                DirectBufferOffset + alignedSize,
+                std::string_view(DirectBuffer + alignedSize, DirectBufferUsed - alignedSize));
+    }
+
+    DirectBufferOffset += DirectBufferUsed;
+    DirectBufferUsed = 0;
+}
+
+void TFileSink::WriteBuffered(const int descriptor, size_t offset, std::string_view data) {
+    while (!data.empty()) {
+        const ssize_t written = pwrite(descriptor, data.data(), data.size(), offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            throw TError("Unable to write to file", false);
+        }
+
+        offset += written;
+        data.remove_prefix(written);
+    }
+}
+
+void TFileSink::WriteBehind(const size_t offset, const size_t size) {
+#ifdef __linux__
+    if (size == 0) {
+        return;
+    }
+
+    // Start writeback of the fresh data right away, and once it is far enough
+    // behind the write head wait for it and drop it from the page cache.
+    sync_file_range(Descriptor, offset, size, SYNC_FILE_RANGE_WRITE);
+
+    WrittenRegions.emplace_back(offset, size);
+    WrittenRegionsSize += size;
+
+    while (WrittenRegionsSize > WriteBehindBytes) {
+        const std::pair<size_t, size_t> region = WrittenRegions.front();
+        WrittenRegions.pop_front();
+        WrittenRegionsSize -= region.second;
+
+        DropWritten(region.first, region.second);
+    }
+#endif
+}
+
+void TFileSink::DropWritten(const size_t offset, const size_t size) {
+#ifdef __linux__
+    sync_file_range(Descriptor, offset, size, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(Descriptor, offset, size, POSIX_FADV_DONTNEED);
+#endif
+}
+
+void TFileSink::CheckIsOpened() const {
+    if (Descriptor == -1) {
+        throw TError("Attempt to use closed file", false);
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "memory_budget.h"
+#include "output_sink.h"
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Output file which keeps large downloads from flooding the page cache:
+// the known size is preallocated up front, written data is pushed to disk
+// and dropped from the cache behind the write head, and optionally the page
+// cache is bypassed altogether with O_DIRECT.
+class TFileSink : public TOutputSink {
+public:
+    TFileSink(const std::string& path, const bool useDirectIo = false);
+    virtual ~TFileSink() override;
+
+    virtual void Allocate(const size_t size) override;
+    virtual void WriteAt(const size_t offset, const std::string_view& data) override;
+    virtual void Close() override;
+
+private:
+    void WriteDirect(size_t offset, std::string_view data);
+    void FlushDirectBuffer();
+
+    void WriteBuffered(const int descriptor, size_t offset, std::string_view data);
+    void WriteBehind(const size_t offset, const size_t size);
+    void DropWritten(const size_t offset, const size_t size);
+
+    void CheckIsOpened() const;
+
+private:
+    std::mutex Mutex;
+
+    int Descriptor = -1;
+    int DirectDescriptor = -1;
+
+    char* DirectBuffer = nullptr;
+    TMemoryBudget::TLease DirectBufferLease;
+    size_t DirectBufferOffset = 0;
+    size_t DirectBufferUsed = 0;
+
+    // Regions which were handed to the kernel but are still in the page cache.
+    std::deque<std::pair<size_t, size_t>> WrittenRegions;
+    size_t WrittenRegionsSize = 0;
+
+    static const size_t DirectIoAlignmentBytes = 4096;
+    static const size_t DirectBufferSizeBytes = 1 * 1024 * 1024;
+    static const size_t WriteBehindBytes = 16 * 1024 * 1024;
+};
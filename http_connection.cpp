@@ -2,8 +2,25 @@
 
 #include "error.h"
 
-THttpConnection::THttpConnection(const std::string& host, const std::string& port) {
-    TcpConnection = std::make_unique<TTcpConnection>(host, port);
+#include <algorithm>
+#include <limits>
+
+THttpConnection::THttpConnection(
+        const TEndpoint& endpoint,
+        const TConnectionOptions& options,
+        std::shared_ptr<TBandwidthGovernor::TTransfer> transfer)
+    : THttpConnection(CreateTransport(endpoint, options), options, std::move(transfer))
+{
+}
+
+THttpConnection::THttpConnection(
+        std::unique_ptr<TTransport> transport,
+        const TConnectionOptions& options,
+        std::shared_ptr<TBandwidthGovernor::TTransfer> transfer)
+    : Options(options)
+    , Transport(std::move(transport))
+    , Transfer(std::move(transfer))
+{
 }
 
 THttpResponse THttpConnection::PerformRequest(
@@ -16,14 +33,46 @@ THttpResponse THttpConnection::PerformRequest(
     return GetResponse(isNeedWaitBody, processBodyChunkCallback);
 }
 
+void THttpConnection::Abort() {
+    // The connection may have finished its request already, then it must not be reused either.
+    Good = false;
+    Transport->Shutdown();
+}
+
 bool THttpConnection::IsGood() const {
-    return Good && TcpConnection->IsGood();
+    return Good && Transport->IsGood();
+}
+
+std::unique_ptr<TTransport> THttpConnection::CreateTransport(const TEndpoint& endpoint, const TConnectionOptions& options) {
+    std::unique_ptr<TSocketConnection> socket = TSocketConnection::Create(endpoint, options.ConnectTimeout, GetOperationTimeout(options));
+    if (!endpoint.UseTls) {
+        return socket;
+    }
+
+    const std::string sessionKey = endpoint.UnixSocketPath.empty() ? endpoint.Host + ":" + endpoint.Port : endpoint.UnixSocketPath;
+    return std::make_unique<TTlsConnection>(
+            std::move(socket),
+            endpoint.Host,
+            sessionKey,
+            options.TlsContext ? options.TlsContext : TTlsContext::GetDefault());
+}
+
+std::chrono::milliseconds THttpConnection::GetOperationTimeout(const TConnectionOptions& options) {
+    // Nothing received during the whole low speed period is too slow as well.
+    std::chrono::milliseconds operationTimeout = options.OperationTimeout;
+    if (options.LowSpeedLimitBytesPerSecond > 0 && options.LowSpeedTime > std::chrono::milliseconds::zero()) {
+        if (operationTimeout == std::chrono::milliseconds::zero() || options.LowSpeedTime < operationTimeout) {
+            operationTimeout = options.LowSpeedTime;
+        }
+    }
+
+    return operationTimeout;
 }
 
 void THttpConnection::SendRequest(const std::string& data) {
     CheckConnectionIsGood();
 
-    TcpConnection->Send(data);
+    Transport->Send(data);
 }
 
 THttpResponse THttpConnection::GetResponse(
@@ -61,6 +110,7 @@ void THttpConnection::TryReadHead(THttpResponse& response) {
     CheckConnectionIsGood();
 
     std::string& buffer = response.HeadRawData;
+    response.HeadLease = TMemoryBudget::Instance().Acquire(DefaultHeadBufferSizeBytes);
     buffer.resize(DefaultHeadBufferSizeBytes);
 
     void* bufferPointer = reinterpret_cast<void*>(&buffer.front());
@@ -68,7 +118,7 @@ void THttpConnection::TryReadHead(THttpResponse& response) {
     int totalPeeked = 0;
 
     while (true) {
-        const int peeked = TcpConnection->PeekChunk(bufferPointer, estimated);
+        const int peeked = Transport->PeekChunk(bufferPointer, estimated);
         if (peeked == 0) {
             Good = false;
             throw TError("Connection closed", true);
@@ -83,7 +133,7 @@ void THttpConnection::TryReadHead(THttpResponse& response) {
             needRead = headSize - (totalPeeked - peeked);
         }
 
-        const int read = TcpConnection->ReceiveChunk(bufferPointer, needRead);
+        const int read = Transport->ReceiveChunk(bufferPointer, needRead);
         if (read == 0) {
             Good = false;
             throw TError("Connection closed", true);
@@ -99,6 +149,7 @@ void THttpConnection::TryReadHead(THttpResponse& response) {
             }
 
             estimated = buffer.size();
+            response.HeadLease.Resize(buffer.size() * 2);
             buffer.resize(buffer.size() * 2);
         }
 
@@ -108,31 +159,60 @@ void THttpConnection::TryReadHead(THttpResponse& response) {
 
 void THttpConnection::TryReadBody(
         THttpResponse& response,
-        const int expectedSize,
+        const size_t expectedSize,
         const std::optional<TBufferFilledCallback>& processBodyChunkCallback) {
     CheckConnectionIsGood();
 
+    if (expectedSize == 0) {
+        return;
+    }
+
     const bool isPartialMode = !!processBodyChunkCallback;
 
-    size_t bufferSize = expectedSize;
+    // The whole body is kept only when there is no callback, otherwise the buffer shrinks under memory pressure.
+    // The head is drawn again together with the body, so that nothing is held while waiting for memory.
+    const size_t headSize = response.HeadLease.GetSize();
+    response.HeadLease.Release();
+
+    TMemoryBudget& budget = TMemoryBudget::Instance();
     if (isPartialMode) {
-        bufferSize = PartialModeBufferSizeBytes;
+        response.BodyLease = budget.AcquireUpTo(
+                headSize + std::min<size_t>(expectedSize, MinPartialModeBufferSizeBytes),
+                headSize + std::min<size_t>(expectedSize, PartialModeBufferSizeBytes));
+    } else {
+        response.BodyLease = budget.Acquire(headSize + expectedSize);
     }
 
+    const size_t bufferSize = response.BodyLease.GetSize() - headSize;
+
     std::string& result = response.BodyRawData;
     result.resize(bufferSize);
 
     void* bufferPointer = reinterpret_cast<void*>(&result.front());
-    int estimatedSize = result.size();
-    int totalReceived = 0;
-    int currentBufferSize = 0;
+    size_t estimatedSize = result.size();
+    size_t totalReceived = 0;
+    size_t currentBufferSize = 0;
+
+    TLowSpeedWatchdog watchdog(Options.LowSpeedLimitBytesPerSecond, Options.LowSpeedTime);
 
     while (true) {
-        const int received = TcpConnection->ReceiveChunk(bufferPointer, estimatedSize);
+        size_t received = 0;
+        try {
+            received = ReceiveBodyChunk(bufferPointer, std::min(estimatedSize, expectedSize - totalReceived), watchdog);
+            if (received == 0) {
+                throw TError("Connection closed", true);
+            }
 
-        if (received == 0) {
+            watchdog.Update(received);
+        } catch (...) {
             Good = false;
-            throw TError("Connection closed", true);
+
+            // Whatever arrived before the failure is handed over, so that a retry can continue from it.
+            if (isPartialMode && currentBufferSize > 0) {
+                (*processBodyChunkCallback)(response, currentBufferSize);
+            }
+
+            throw;
         }
 
         bufferPointer = static_cast<char*>(bufferPointer) + received;
@@ -141,7 +221,17 @@ void THttpConnection::TryReadBody(
         currentBufferSize += received;
 
         if (isPartialMode && (estimatedSize == 0 || totalReceived == expectedSize)) {
-            (*processBodyChunkCallback)(response, currentBufferSize);
+            // A slow consumer (a sink applying backpressure, a pipe to a slow reader) is not a slow transfer.
+            const std::chrono::steady_clock::time_point callbackStart = std::chrono::steady_clock::now();
+            try {
+                (*processBodyChunkCallback)(response, currentBufferSize);
+            } catch (...) {
+                // The rest of the body is left unread.
+                Good = false;
+                throw;
+            }
+
+            watchdog.Exclude(std::chrono::steady_clock::now() - callbackStart);
 
             currentBufferSize = 0;
             estimatedSize = result.size();
@@ -154,15 +244,42 @@ void THttpConnection::TryReadBody(
     }
 }
 
+size_t THttpConnection::ReceiveBodyChunk(void* result, const size_t estimatedSize, TLowSpeedWatchdog& watchdog) {
+    // A body may be bigger than one read of the transport can take.
+    const size_t chunkSize = std::min<size_t>(estimatedSize, std::numeric_limits<int>::max());
+    if (!Transfer) {
+        return Transport->ReceiveChunk(result, chunkSize);
+    }
+
+    TBandwidthGovernor& governor = TBandwidthGovernor::Instance();
+
+    const std::chrono::steady_clock::time_point acquireStart = std::chrono::steady_clock::now();
+    const size_t allowed = governor.Acquire(*Transfer, chunkSize);
+    watchdog.Exclude(std::chrono::steady_clock::now() - acquireStart);
+
+    size_t received = 0;
+    try {
+        received = Transport->ReceiveChunk(result, allowed);
+    } catch (...) {
+        governor.Refund(*Transfer, allowed);
+        throw;
+    }
+
+    governor.Refund(*Transfer, allowed - received);
+    return received;
+}
+
 int THttpConnection::TryParseHead(
         const std::string& data,
         const int start,
         const int end,
         THttpResponse& response) {
-    // todo rnrn may overlap chunk border
-    size_t position = std::string_view(data.data() + start, end - start).find("\r\n\r\n");
+    // The separator may be split between two reads.
+    const int searchStart = std::max(start - 3, 0);
+
+    size_t position = std::string_view(data.data() + searchStart, end - searchStart).find("\r\n\r\n");
     if (position != std::string::npos) {
-        position += start + 4;
+        position += searchStart + 4;
 
         if (!THttpResponseParser::ParseHttpResponse(std::string_view(data.data(), position), response)) {
             throw TError("Cannot parse response", false);
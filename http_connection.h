@@ -1,26 +1,65 @@
 #pragma once
 
+#include "bandwidth_governor.h"
 #include "http_response_parser.h"
-#include "tcp_connection.h"
+#include "low_speed_watchdog.h"
+#include "socket_connection.h"
+#include "tls_connection.h"
+#include "transport.h"
 
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <memory>
 #include <string>
 
+class TConnectionOptions {
+public:
+    // Zero means "wait forever".
+    std::chrono::milliseconds ConnectTimeout = std::chrono::seconds(30);
+    // Limits every single send and receive, not the whole request.
+    std::chrono::milliseconds OperationTimeout = std::chrono::seconds(60);
+
+    // A body is abandoned when less than LowSpeedLimitBytesPerSecond arrive
+    // on average during LowSpeedTime. Zero limit disables the check.
+    size_t LowSpeedLimitBytesPerSecond = 0;
+    std::chrono::milliseconds LowSpeedTime = std::chrono::seconds(30);
+
+    // Used for endpoints with TLS, empty means the default one shared by the whole process.
+    std::shared_ptr<TTlsContext> TlsContext;
+};
+
 class THttpConnection {
 public:
     using TBufferFilledCallback = std::function<void(const THttpResponse&, const size_t)>;
 
 public:
-    THttpConnection(const std::string& host, const std::string& port);
+    THttpConnection(
+            const TEndpoint& endpoint,
+            const TConnectionOptions& options = TConnectionOptions(),
+            std::shared_ptr<TBandwidthGovernor::TTransfer> transfer = std::shared_ptr<TBandwidthGovernor::TTransfer>());
+    // Talks over an already established transport; its timeouts are up to the caller.
+    THttpConnection(
+            std::unique_ptr<TTransport> transport,
+            const TConnectionOptions& options = TConnectionOptions(),
+            std::shared_ptr<TBandwidthGovernor::TTransfer> transfer = std::shared_ptr<TBandwidthGovernor::TTransfer>());
 
     THttpResponse PerformRequest(
             const std::string& request,
             const bool isNeedWaitBody,
             const std::optional<TBufferFilledCallback>& processBodyChunkCallback = std::optional<TBufferFilledCallback>());
 
+    // Interrupts the request in progress, may be called from another thread.
+    void Abort();
+
     bool IsGood() const;
 
+    // Socket, wrapped into TLS when the endpoint asks for it.
+    static std::unique_ptr<TTransport> CreateTransport(const TEndpoint& endpoint, const TConnectionOptions& options);
+
+    // Socket operation timeout which also catches a transfer stalled for the whole low speed period.
+    static std::chrono::milliseconds GetOperationTimeout(const TConnectionOptions& options);
+
 private:
     void SendRequest(const std::string& data);
 
@@ -32,9 +71,11 @@ private:
 
     void TryReadBody(
             THttpResponse& response,
-            const int expectedSize,
+            const size_t expectedSize,
             const std::optional<TBufferFilledCallback>& processBodyChunkCallback);
 
+    size_t ReceiveBodyChunk(void* result, const size_t estimatedSize, TLowSpeedWatchdog& watchdog);
+
     int TryParseHead(
             const std::string& data,
             const int start,
@@ -44,11 +85,16 @@ private:
     void CheckConnectionIsGood() const;
 
 private:
-    std::unique_ptr<TTcpConnection> TcpConnection;
-    bool Good = true;
+    const TConnectionOptions Options;
+
+    std::unique_ptr<TTransport> Transport;
+    std::shared_ptr<TBandwidthGovernor::TTransfer> Transfer;
+    // Cleared by Abort from another thread as well.
+    std::atomic<bool> Good{true};
 
     static const size_t DefaultHeadBufferSizeBytes = 10 * 1024;
     static const size_t MaxHeadSizeBytes = 1 * 1024 * 1024;
     static const size_t PartialModeBufferSizeBytes = 8 * 1024 * 1024;
+    static const size_t MinPartialModeBufferSizeBytes = 64 * 1024;
 };
 
@@ -1,135 +1,448 @@
 #include "http_file_downloader.h"
 #include "http_request_builder.h"
+#include "file_sink.h"
+#include "memory_budget.h"
+#include "range_scheduler.h"
+#include "retry_policy.h"
+#include "stream_sink.h"
 #include "error.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <fcntl.h>
+#include <mutex>
 #include <thread>
 #include <regex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
 
 const std::string THttpFileDownloader::DefaultPort("80");
+const std::string THttpFileDownloader::DefaultTlsPort("443");
+const std::string THttpFileDownloader::TemporarySuffix(".part");
+const std::string THttpFileDownloader::UnixSocketHost("localhost");
 
-using TDuration = std::chrono::duration<long long, std::milli>;
+THttpFileDownloader::THttpFileDownloader(const std::string& url, const TDownloadOptions& options)
+    : Options(options)
+{
+    ParseUrl(url, Endpoint, Path);
 
-void DoWithRetry(const std::function<void()>& action, const int maxTryCount, const TDuration& sleepDuration = TDuration(2000)) {
-    int tryCount = 1;
-
-    while (true) {
-        try {
-            action();
-            break;
-        } catch (const TError& error) {
-            if (!error.IsNeedRetry() || tryCount >= maxTryCount) {
-                throw;
-            }
-
-            std::this_thread::sleep_for(sleepDuration);
-            ++tryCount;
-        } catch (...) {
-            throw;
-        }
+    if (Endpoint.Port.empty()) {
+        Endpoint.Port = Endpoint.UseTls ? DefaultTlsPort : DefaultPort;
     }
-}
 
-THttpFileDownloader::THttpFileDownloader(const std::string& url) {
-    ParseUrl(url, Host, Port, Path);
+    Transfer = TBandwidthGovernor::Instance().Register(Endpoint.Host, Options.Priority);
+}
 
-    if (Port.empty()) {
-        Port = DefaultPort;
+void THttpFileDownloader::Download(const std::string& outputFilePath) {
+    std::unique_ptr<TOutputSink> sink;
+    if (outputFilePath == "-") {
+        sink = std::make_unique<TStreamSink>(TStreamSink::CreateDescriptorWriter(STDOUT_FILENO));
+    } else {
+        sink = std::make_unique<TFileSink>(outputFilePath, Options.DirectIo);
     }
+
+    Download(*sink);
+    sink->Close();
 }
 
-void THttpFileDownloader::Download(const std::string& outputFilePath) {
+void THttpFileDownloader::Download(TOutputSink& sink) {
+    DownloadStart = std::chrono::steady_clock::now();
+
+    // Instead of a separate HEAD request the first bytes are requested right away:
+    // the response tells the size of the resource and whether ranges are supported,
+    // and small resources are complete after a single round trip.
     size_t resourceSize = 0;
+    size_t fetchedDataSize = 0;
     bool hasByteRange = false;
+    bool isResourceInformationKnown = false;
+
+    const auto probe = [&]() {
+        // Once the probe got to the body, the rest is fetched from where it broke.
+        if (isResourceInformationKnown) {
+            return;
+        }
+
+        EnsureConnectionIsOpened(HttpConnection);
+
+        std::string request = THttpRequestBuilder::BuildGetWithRangeRequest(Endpoint.Host, Path, 0, ProbeSizeBytes - 1);
+        AddPriority(request);
+
+        const auto learnResourceInformation = [&](const THttpResponse& response) {
+            if (!isResourceInformationKnown) {
+                ParseResourceInformation(response, resourceSize, hasByteRange);
+                sink.Allocate(resourceSize);
 
-    const auto getResourceInformation = [&]() {
-        EnsureConnectionIsOpened();
+                isResourceInformationKnown = true;
+            }
+        };
+
+        const THttpConnection::TBufferFilledCallback writeBodyChunk = [&](const THttpResponse& response, const size_t bufferSize) {
+            learnResourceInformation(response);
+            if (response.StatusCode / 100 != 2) {
+                return;
+            }
 
-        const THttpResponse headResponse = HttpConnection->PerformRequest(THttpRequestBuilder::BuildHeadRequest(Host, Path), false);
-        CheckResponseStatusCode(headResponse);
+            sink.WriteAt(fetchedDataSize, std::string_view(response.BodyRawData.data(), bufferSize));
 
-        hasByteRange = headResponse.HasHeaderAndValue("Accept-Ranges", "bytes");
-        resourceSize = *headResponse.GetContentLength();
+            fetchedDataSize += bufferSize;
+        };
+
+        const THttpResponse response = HttpConnection->PerformRequest(request, true, writeBodyChunk);
+        learnResourceInformation(response);
     };
 
-    DoWithRetry(getResourceInformation, TryCount);
+    DoWithRetry(probe, GetRetryPolicy());
+
+    if (fetchedDataSize == resourceSize) {
+        return;
+    }
 
-    if (resourceSize >= EnableByteRangeThresholdBytes && hasByteRange) {
-        DownloadWithGetRanges(outputFilePath, resourceSize);
+    if (hasByteRange && resourceSize - fetchedDataSize >= EnableByteRangeThresholdBytes) {
+        DownloadWithGetRanges(sink, fetchedDataSize, resourceSize);
     } else {
-        DownloadWithGetSimple(outputFilePath, resourceSize);
+        DownloadWithGetSimple(sink, fetchedDataSize, resourceSize, hasByteRange);
     }
 }
 
-void THttpFileDownloader::DownloadWithGetRanges(const std::string& outputFilePath, const size_t resourceSize) {
-    OpenFileStream(outputFilePath);
+size_t THttpFileDownloader::DownloadDelta(const std::string& outputFilePath, const std::string& basePath, const TBlockIndex& index) {
+    // Blocks are copied and fetched in any order, which a stream cannot take.
+    if (outputFilePath == "-") {
+        throw TError("Delta download needs an output file", false);
+    }
 
-    size_t nextByteToFetch = 0;
-    size_t fetchedDataSize = 0;
+    DownloadStart = std::chrono::steady_clock::now();
 
-    const auto fetchChunk = [&]() {
-        if (resourceSize == 0) {
-            return;
+    // The file is assembled aside and moved over the output at the end,
+    // so the base may be the output itself (an update in place).
+    const std::string temporaryPath = outputFilePath + TemporarySuffix;
+    size_t bytesToFetch = 0;
+
+    try {
+        TFileSink sink(temporaryPath, Options.DirectIo);
+        sink.Allocate(index.Size);
+
+        std::vector<bool> isBlockCopied(index.Blocks.size(), false);
+        CopyBlocks(sink, index, basePath, isBlockCopied);
+
+        // Runs of missing blocks are fetched by ranges no longer than the usual chunk.
+        size_t connectionCount = 0;
+        size_t chunkSize = 0;
+        ChooseRangeLayout(connectionCount, chunkSize);
+        const size_t maxRangeBlocks = std::max<size_t>(chunkSize / index.BlockSize, 1);
+
+        std::vector<std::pair<size_t, size_t>> blockRanges;
+        for (size_t block = 0; block < index.Blocks.size(); ++block) {
+            if (isBlockCopied[block]) {
+                continue;
+            }
+
+            bytesToFetch += index.GetBlockDataSize(block);
+
+            if (!blockRanges.empty() && blockRanges.back().second + 1 == block && block - blockRanges.back().first < maxRangeBlocks) {
+                blockRanges.back().second = block;
+            } else {
+                blockRanges.emplace_back(block, block);
+            }
         }
 
-        EnsureConnectionIsOpened();
+        DownloadBlocks(sink, index, blockRanges);
+        sink.Close();
+    } catch (...) {
+        unlink(temporaryPath.c_str());
+        throw;
+    }
 
-        const std::string request =
-                THttpRequestBuilder::BuildGetWithRangeRequest(
-                    Host,
-                    Path,
-                    nextByteToFetch,
-                    std::min(nextByteToFetch + ByteRangeChunkSizeBytes, resourceSize - 1));
+    if (rename(temporaryPath.c_str(), outputFilePath.c_str()) == -1) {
+        unlink(temporaryPath.c_str());
+        throw TError("Cannot move " + temporaryPath + " to " + outputFilePath, false);
+    }
 
-        const THttpResponse response = HttpConnection->PerformRequest(request, true);
-        CheckResponseStatusCode(response);
+    return bytesToFetch;
+}
+
+void THttpFileDownloader::CopyBlocks(TOutputSink& sink, const TBlockIndex& index, const std::string& basePath, std::vector<bool>& isBlockCopied) {
+    const int descriptor = open(basePath.c_str(), O_RDONLY);
+    if (descriptor == -1) {
+        throw TError("Cannot open " + basePath, false);
+    }
+
+    struct stat baseStat;
+    if (fstat(descriptor, &baseStat) == -1) {
+        close(descriptor);
+        throw TError("Cannot stat " + basePath, false);
+    }
+
+    const size_t size = baseStat.st_size;
+    if (size == 0) {
+        close(descriptor);
+        return;
+    }
+
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+
+    if (mapping == MAP_FAILED) {
+        throw TError("Cannot map " + basePath, false);
+    }
+
+    try {
+        madvise(mapping, size, MADV_SEQUENTIAL);
+
+        const char* data = static_cast<const char*>(mapping);
+        const std::vector<std::optional<size_t>> foundBlocks = index.FindBlocks(data, size);
+
+        for (size_t block = 0; block < foundBlocks.size(); ++block) {
+            if (!foundBlocks[block]) {
+                continue;
+            }
+
+            // A block found at the very end of the base may be partly made of the zero padding.
+            const size_t offset = *foundBlocks[block];
+            const size_t blockSize = index.GetBlockDataSize(block);
+            const size_t baseBytes = std::min(blockSize, size - offset);
+
+            sink.WriteAt(index.GetBlockOffset(block), std::string_view(data + offset, baseBytes));
+            if (baseBytes < blockSize) {
+                sink.WriteAt(index.GetBlockOffset(block) + baseBytes, std::string(blockSize - baseBytes, '\0'));
+            }
+
+            isBlockCopied[block] = true;
+        }
+    } catch (...) {
+        munmap(mapping, size);
+        throw;
+    }
+
+    munmap(mapping, size);
+}
+
+void THttpFileDownloader::DownloadBlocks(TOutputSink& sink, const TBlockIndex& index, const std::vector<std::pair<size_t, size_t>>& blockRanges) {
+    std::atomic<size_t> nextRange(0);
+    std::atomic<bool> isCancelled(false);
+
+    const auto fetchRanges = [&](std::unique_ptr<THttpConnection>& connection) {
+        for (size_t range = nextRange++; range < blockRanges.size() && !isCancelled; range = nextRange++) {
+            const size_t firstBlock = blockRanges[range].first;
+            const size_t lastBlock = blockRanges[range].second;
+
+            const size_t firstByte = index.GetBlockOffset(firstBlock);
+            const size_t lastByte = index.GetBlockOffset(lastBlock) + index.GetBlockDataSize(lastBlock) - 1;
+
+            const auto fetchRange = [&]() {
+                EnsureConnectionIsOpened(connection);
 
-        WriteDataToFile(response.BodyRawData);
+                std::string request = THttpRequestBuilder::BuildGetWithRangeRequest(Endpoint.Host, Path, firstByte, lastByte);
+                AddPriority(request);
+                const THttpResponse response = connection->PerformRequest(request, true);
 
-        fetchedDataSize += *response.GetContentLength();
-        nextByteToFetch += ByteRangeChunkSizeBytes + 1;
+                CheckPartialContent(response, firstByte);
+                if (response.GetContentRange()->Total != index.Size || response.BodyRawData.size() != lastByte - firstByte + 1) {
+                    throw TError("Server returned unexpected range", false);
+                }
+
+                // A file which has changed since the index was made is never assembled.
+                for (size_t block = firstBlock; block <= lastBlock; ++block) {
+                    if (!index.CheckBlock(block, response.BodyRawData.data() + index.GetBlockOffset(block) - firstByte)) {
+                        throw TError("Fetched block does not match the index", false);
+                    }
+                }
+
+                sink.WriteAt(firstByte, response.BodyRawData);
+            };
+
+            DoWithRetry(fetchRange, GetRetryPolicy());
+        }
+    };
+
+    size_t connectionCount = 0;
+    size_t chunkSize = 0;
+    ChooseRangeLayout(connectionCount, chunkSize);
+    connectionCount = std::min(connectionCount, std::max<size_t>(blockRanges.size(), 1));
+
+    RunFetchers(connectionCount, fetchRanges, [&]() {
+        isCancelled = true;
+    });
+}
+
+void THttpFileDownloader::DownloadWithGetRanges(TOutputSink& sink, const size_t firstByteToFetch, const size_t resourceSize) {
+    // Every connection takes the next range as soon as it is done with the previous one.
+    // A connection blocked by the sink (the reorder buffer is full) takes no new ranges.
+    size_t connectionCount = 0;
+    size_t chunkSize = 0;
+    ChooseRangeLayout(connectionCount, chunkSize);
+
+    TRangeScheduler scheduler(firstByteToFetch, resourceSize, chunkSize);
+
+    const auto fetchRanges = [&](std::unique_ptr<THttpConnection>& connection) {
+        while (const std::shared_ptr<TRangeScheduler::TRange> range = scheduler.Next()) {
+            const auto fetchChunk = [&]() {
+                EnsureConnectionIsOpened(connection);
+                if (!scheduler.Attach(*range, *connection)) {
+                    return;
+                }
+
+                std::string request = THttpRequestBuilder::BuildGetWithRangeRequest(Endpoint.Host, Path, range->FirstByte, range->LastByte, Validator);
+                AddPriority(request);
+                const TRangeScheduler::TClock::time_point startTime = TRangeScheduler::TClock::now();
+
+                bool isOutrun = false;
+                const auto performRequest = [&]() {
+                    try {
+                        return connection->PerformRequest(request, true);
+                    } catch (const TError&) {
+                        scheduler.Detach(*range, *connection);
+
+                        // Aborted because another copy of the range has won.
+                        if (!scheduler.IsDone(*range)) {
+                            throw;
+                        }
+
+                        isOutrun = true;
+                        return THttpResponse();
+                    }
+                };
+
+                const THttpResponse response = performRequest();
+                if (isOutrun) {
+                    return;
+                }
+
+                scheduler.Detach(*range, *connection);
+
+                CheckPartialContent(response, range->FirstByte);
+                if (response.BodyRawData.size() != range->LastByte - range->FirstByte + 1) {
+                    throw TError("Server returned unexpected range", false);
+                }
+
+                if (scheduler.Complete(*range, TRangeScheduler::TClock::now() - startTime)) {
+                    sink.WriteAt(range->FirstByte, response.BodyRawData);
+                }
+            };
+
+            DoWithRetry(fetchChunk, GetRetryPolicy());
+        }
     };
 
-    while (true) {
-        DoWithRetry(fetchChunk, TryCount);
-        if (fetchedDataSize == resourceSize) {
-            break;
+    RunFetchers(connectionCount, fetchRanges, [&]() {
+        scheduler.Cancel();
+        sink.Cancel();
+    });
+}
+
+void THttpFileDownloader::RunFetchers(const size_t connectionCount, const TFetcher& fetch, const std::function<void()>& cancel) {
+    std::mutex mutex;
+    std::exception_ptr error;
+
+    const auto runFetcher = [&](std::unique_ptr<THttpConnection>& connection) {
+        try {
+            fetch(connection);
+        } catch (...) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+
+            cancel();
         }
+    };
+
+    std::vector<std::unique_ptr<THttpConnection>> connections(connectionCount - 1);
+    std::vector<std::thread> fetchers;
+    for (std::unique_ptr<THttpConnection>& connection : connections) {
+        fetchers.emplace_back(runFetcher, std::ref(connection));
+    }
+
+    runFetcher(HttpConnection);
+
+    for (std::thread& fetcher : fetchers) {
+        fetcher.join();
     }
 
-    CloseFileStream();
+    if (error) {
+        std::rethrow_exception(error);
+    }
 }
 
-void THttpFileDownloader::DownloadWithGetSimple(const std::string& outputFilePath, const size_t resourceSize) {
+void THttpFileDownloader::DownloadWithGetSimple(
+        TOutputSink& sink,
+        const size_t firstByteToFetch,
+        const size_t resourceSize,
+        const bool hasByteRange) {
+    size_t fetchedDataSize = firstByteToFetch;
+
     const auto fetch = [&]() {
-        OpenFileStream(outputFilePath);
+        // Every retry continues from the last written byte. Without ranges the
+        // content is fetched from the beginning and the sink skips what it already has.
+        const size_t firstByte = hasByteRange ? fetchedDataSize : 0;
+
+        std::string request;
+        if (firstByte == 0) {
+            request = THttpRequestBuilder::BuildGetRequest(Endpoint.Host, Path);
+        } else {
+            request = THttpRequestBuilder::BuildGetFromOffsetRequest(Endpoint.Host, Path, firstByte, Validator);
+        }
 
-        const std::string request = THttpRequestBuilder::BuildGetRequest(Host, Path);
+        AddPriority(request);
 
         size_t totalBodyBytesWrited = 0;
         const THttpConnection::TBufferFilledCallback writeBodyChunk = [&](const THttpResponse& response, const size_t bufferSize) {
-            WriteDataToFile(std::string_view(response.BodyRawData.data(), bufferSize));
+            if (firstByte == 0) {
+                CheckResponseStatusCode(response);
+            } else {
+                CheckPartialContent(response, firstByte);
+            }
+
+            sink.WriteAt(firstByte + totalBodyBytesWrited, std::string_view(response.BodyRawData.data(), bufferSize));
 
             totalBodyBytesWrited += bufferSize;
+            fetchedDataSize = std::max(fetchedDataSize, firstByte + totalBodyBytesWrited);
         };
 
-        EnsureConnectionIsOpened();
+        EnsureConnectionIsOpened(HttpConnection);
         const THttpResponse response = HttpConnection->PerformRequest(request, true, writeBodyChunk);
         CheckResponseStatusCode(response);
 
-        if (totalBodyBytesWrited == resourceSize) {
-             return;
-        } else {
-            throw TError("...", false);
+        if (firstByte + totalBodyBytesWrited != resourceSize) {
+            throw TError("Server returned unexpected content size", false);
         }
-
-        CloseFileStream();
     };
 
-    DoWithRetry(fetch, TryCount);
+    DoWithRetry(fetch, GetRetryPolicy());
+}
+
+void THttpFileDownloader::ParseResourceInformation(const THttpResponse& response, size_t& resourceSize, bool& hasByteRange) {
+    const std::optional<TContentRange> contentRange = response.GetContentRange();
+
+    if (response.StatusCode == 206) {
+        if (!contentRange || !contentRange->Total || contentRange->First != 0) {
+            throw TError("Server returned unexpected range", false);
+        }
+
+        resourceSize = *contentRange->Total;
+        hasByteRange = true;
+        Validator = GetValidator(response);
+        return;
+    }
+
+    // The only resource which cannot satisfy "bytes=0-N" is an empty one.
+    if (response.StatusCode == 416 && contentRange && contentRange->Total == 0u) {
+        resourceSize = 0;
+        hasByteRange = false;
+        return;
+    }
+
+    CheckResponseStatusCode(response);
+
+    resourceSize = *response.GetContentLength();
+    hasByteRange = false;
 }
 
-void THttpFileDownloader::ParseUrl(const std::string& url, std::string& host, std::string& port, std::string& path) {
+void THttpFileDownloader::ParseUrl(const std::string& url, TEndpoint& endpoint, std::string& path) {
     // <schema>://<host>:<port><path>
     const std::regex urlRegex("^([^:/?#]+):\/\/([^:/?#]+)(:)?([^:/?#]+)?(\/.+)$", std::regex::icase | std::regex::ECMAScript);
     std::smatch pieces_match;
@@ -145,10 +458,26 @@ void THttpFileDownloader::ParseUrl(const std::string& url, std::string& host, st
     }
 
     schema = pieces_match[1].str();
-    host = pieces_match[2].str();
-    port = pieces_match[4].str();
+    endpoint.Host = pieces_match[2].str();
+    endpoint.Port = pieces_match[4].str();
     path = pieces_match[5].str();
 
+    // http+unix://<percent-encoded socket path><path>, e.g. http+unix://%2Frun%2Fcache.sock/file
+    if (schema == "http+unix") {
+        if (!endpoint.Port.empty()) {
+            throw TError(url + " is not a valid URI", false);
+        }
+
+        endpoint.UnixSocketPath = DecodePercentEncoding(endpoint.Host);
+        endpoint.Host = UnixSocketHost;
+        return;
+    }
+
+    if (schema == "https") {
+        endpoint.UseTls = true;
+        return;
+    }
+
     if (schema != "http") {
           std::string errorText;
           {
@@ -160,57 +489,113 @@ void THttpFileDownloader::ParseUrl(const std::string& url, std::string& host, st
       }
 }
 
-void THttpFileDownloader::EnsureConnectionIsOpened() {
-    if (HttpConnection && !HttpConnection->IsGood()) {
-        HttpConnection.reset();
+std::string THttpFileDownloader::DecodePercentEncoding(const std::string& value) {
+    std::string result;
+    result.reserve(value.size());
+
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (value[i] != '%') {
+            result.push_back(value[i]);
+            continue;
+        }
+
+        if (i + 2 >= value.size() || !isxdigit(value[i + 1]) || !isxdigit(value[i + 2])) {
+            throw TError(value + " is not properly percent-encoded", false);
+        }
+
+        result.push_back(static_cast<char>(std::stoi(value.substr(i + 1, 2), nullptr, 16)));
+        i += 2;
     }
 
-    if (!HttpConnection) {
-        HttpConnection = std::make_unique<THttpConnection>(Host, Port);
+    return result;
+}
+
+TRetryPolicy THttpFileDownloader::GetRetryPolicy() const {
+    // The deadline is for the whole download, so every request gets what is left of it.
+    TRetryPolicy policy = Options.Retry;
+    if (policy.Deadline != std::chrono::milliseconds::zero()) {
+        const std::chrono::milliseconds elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - DownloadStart);
+        policy.Deadline = std::max(policy.Deadline - elapsed, std::chrono::milliseconds(1));
     }
+
+    return policy;
 }
 
-void THttpFileDownloader::CheckResponseStatusCode(const THttpResponse& response) {
-    if (response.StatusCode / 100 != 2) {
-        std::string errorText;
-        {
-            errorText.append("ERROR: ");
-            errorText.append(std::to_string(response.StatusCode));
-            errorText.append(" ");
-            errorText.append(response.StatusText);
-        }
+void THttpFileDownloader::ChooseRangeLayout(size_t& connectionCount, size_t& chunkSizeBytes) const {
+    // Every range is kept in memory whole until it is written, and a connection may hold
+    // it while waiting for the sink. Under a memory budget ranges and the number of
+    // connections shrink, so that all connections hold a range at once in a third of
+    // the budget. The stream reorder buffer takes at most a half of it, so the range
+    // the output waits for can always be fetched.
+    const size_t available = TMemoryBudget::Instance().GetAvailable();
 
-        throw TError(errorText, false);
+    connectionCount = std::max<size_t>(Options.ParallelConnections, 1);
+    connectionCount = std::min(connectionCount, std::max<size_t>(available / (3 * MinByteRangeChunkSizeBytes), 1));
+
+    chunkSizeBytes = std::clamp(available / (3 * connectionCount), MinByteRangeChunkSizeBytes, ByteRangeChunkSizeBytes);
+}
+
+void THttpFileDownloader::EnsureConnectionIsOpened(std::unique_ptr<THttpConnection>& connection) {
+    if (connection && !connection->IsGood()) {
+        connection.reset();
+    }
+
+    if (!connection) {
+        if (Options.TransportFactory) {
+            connection = std::make_unique<THttpConnection>(Options.TransportFactory(Endpoint), Options.Connection, Transfer);
+        } else {
+            connection = std::make_unique<THttpConnection>(Endpoint, Options.Connection, Transfer);
+        }
     }
 }
 
-void THttpFileDownloader::CheckFileStream() {
-    if (Stream && !Stream->good()) {
-        throw TError("Unable to write to file", false);
+std::string THttpFileDownloader::GetValidator(const THttpResponse& response) {
+    // Weak entity tags cannot be used with If-Range.
+    const std::optional<std::string_view> entityTag = response.GetHeaderValue("ETag");
+    if (entityTag && entityTag->compare(0, 2, "W/") != 0) {
+        return std::string(*entityTag);
     }
+
+    const std::optional<std::string_view> lastModified = response.GetHeaderValue("Last-Modified");
+    if (lastModified) {
+        return std::string(*lastModified);
+    }
+
+    return std::string();
 }
 
-void THttpFileDownloader::OpenFileStream(const std::string& path) {
-    if (Stream) {
-        CloseFileStream();
+void THttpFileDownloader::AddPriority(std::string& request) const {
+    if (Endpoint.UnixSocketPath.empty() || Options.Priority == TBandwidthGovernor::DefaultWeight) {
+        return;
     }
 
-    Stream = std::make_unique<std::ofstream>(path);
-    CheckFileStream();
+    THttpRequestBuilder::AddPriority(Options.Priority, request);
 }
 
-void THttpFileDownloader::WriteDataToFile(const std::string_view& data) {
-    CheckFileStream();
-    Stream->write(data.data(), data.size());
-    Stream->flush();
-    CheckFileStream();
+void THttpFileDownloader::CheckPartialContent(const THttpResponse& response, const size_t firstByte) {
+    CheckResponseStatusCode(response);
+
+    // With If-Range the server sends the whole content when it has changed since the first request.
+    if (response.StatusCode == 200 && !Validator.empty()) {
+        throw TError("Resource has changed during download", false);
+    }
+
+    const std::optional<TContentRange> contentRange = response.GetContentRange();
+    if (response.StatusCode != 206 || !contentRange || contentRange->First != firstByte) {
+        throw TError("Server returned unexpected range", false);
+    }
 }
 
-void THttpFileDownloader::CloseFileStream() {
-    CheckFileStream();
-    Stream->flush();
-    Stream->close();
-    CheckFileStream();
+void THttpFileDownloader::CheckResponseStatusCode(const THttpResponse& response) {
+    if (response.StatusCode / 100 != 2) {
+        std::string errorText;
+        {
+            errorText.append("ERROR: ");
+            errorText.append(std::to_string(response.StatusCode));
+            errorText.append(" ");
+            errorText.append(response.StatusText);
+        }
 
-    Stream.reset();
+        throw TError(errorText, false);
+    }
 }
@@ -1,42 +1,99 @@
 #pragma once
 
+#include "block_index.h"
 #include "http_connection.h"
+#include "output_sink.h"
+#include "retry_policy.h"
 
+#include <chrono>
+#include <functional>
 #include <memory>
 #include <string>
-#include <fstream>
+#include <utility>
+#include <vector>
+
+class TDownloadOptions {
+public:
+    // Share of the bandwidth relative to other transfers when a rate limit is set.
+    size_t Priority = TBandwidthGovernor::DefaultWeight;
+    // Write the output with O_DIRECT, bypassing the page cache.
+    bool DirectIo = false;
+    // Number of connections fetching ranges of a big file at the same time.
+    size_t ParallelConnections = 1;
+
+    TConnectionOptions Connection;
+    // Retry.Deadline is counted from the start of the whole download.
+    TRetryPolicy Retry;
+
+    // Creates transports for the connections instead of plain sockets (to record or replay the traffic).
+    std::function<std::unique_ptr<TTransport>(const TEndpoint&)> TransportFactory;
+};
 
 class THttpFileDownloader {
 public:
-    THttpFileDownloader(const std::string& url);
+    THttpFileDownloader(const std::string& url, const TDownloadOptions& options = TDownloadOptions());
 
+    // "-" means standard output.
     void Download(const std::string& outputFilePath);
+    void Download(TOutputSink& sink);
+    // Builds the file described by the index from the blocks of the base file
+    // and fetches only the blocks it does not have. Returns the number of bytes fetched.
+    size_t DownloadDelta(const std::string& outputFilePath, const std::string& basePath, const TBlockIndex& index);
 
 private:
-    void DownloadWithGetRanges(const std::string& outputFilePath, const size_t resourceSize);
-    void DownloadWithGetSimple(const std::string& outputFilePath, const size_t resourceSize);
+    void DownloadWithGetRanges(TOutputSink& sink, const size_t firstByteToFetch, const size_t resourceSize);
+    void DownloadWithGetSimple(
+            TOutputSink& sink,
+            const size_t firstByteToFetch,
+            const size_t resourceSize,
+            const bool hasByteRange);
 
-    void ParseUrl(const std::string& url, std::string& host, std::string& port, std::string& path);
+    void DownloadBlocks(TOutputSink& sink, const TBlockIndex& index, const std::vector<std::pair<size_t, size_t>>& blockRanges);
+    void CopyBlocks(TOutputSink& sink, const TBlockIndex& index, const std::string& basePath, std::vector<bool>& isBlockCopied);
 
-    void EnsureConnectionIsOpened();
+    using TFetcher = std::function<void(std::unique_ptr<THttpConnection>& connection)>;
+    // Runs fetch over connectionCount connections at once, HttpConnection is the first of them.
+    // The first failure calls cancel so that the others stop, and is rethrown when all are done.
+    void RunFetchers(const size_t connectionCount, const TFetcher& fetch, const std::function<void()>& cancel);
 
-    void CheckResponseStatusCode(const THttpResponse& response);
+    void ParseResourceInformation(const THttpResponse& response, size_t& resourceSize, bool& hasByteRange);
+
+    void ParseUrl(const std::string& url, TEndpoint& endpoint, std::string& path);
+    std::string DecodePercentEncoding(const std::string& value);
 
-    void CheckFileStream();
-    void OpenFileStream(const std::string& path);
-    void WriteDataToFile(const std::string_view& data);
-    void CloseFileStream();
+    TRetryPolicy GetRetryPolicy() const;
+    void ChooseRangeLayout(size_t& connectionCount, size_t& chunkSizeBytes) const;
+
+    void EnsureConnectionIsOpened(std::unique_ptr<THttpConnection>& connection);
+
+    std::string GetValidator(const THttpResponse& response);
+    // A server behind a Unix domain socket may be the lruc daemon, which downloads with the priority of the request.
+    void AddPriority(std::string& request) const;
+
+    void CheckPartialContent(const THttpResponse& response, const size_t firstByte);
+    void CheckResponseStatusCode(const THttpResponse& response);
 
 private:
-    std::string Host;
-    std::string Port;
+    TEndpoint Endpoint;
     std::string Path;
 
+    // ETag or Last-Modified of the first response, sent with If-Range so that
+    // parts of different versions of the resource are never mixed.
+    std::string Validator;
+
+    const TDownloadOptions Options;
+    std::chrono::steady_clock::time_point DownloadStart;
+    std::shared_ptr<TBandwidthGovernor::TTransfer> Transfer;
+
     std::unique_ptr<THttpConnection> HttpConnection;
-    std::unique_ptr<std::ofstream> Stream;
 
     static const std::string DefaultPort;
+    static const std::string DefaultTlsPort;
+    static const std::string TemporarySuffix;
+    // Host header for servers behind a Unix domain socket.
+    static const std::string UnixSocketHost;
+    static const size_t ProbeSizeBytes = 1 * 1024 * 1024;
     static const size_t EnableByteRangeThresholdBytes = 32 * 1024 * 1024;
     static const size_t ByteRangeChunkSizeBytes = 8 * 1024 * 1024;
-    static const size_t TryCount = 5;
+    static const size_t MinByteRangeChunkSizeBytes = 256 * 1024;
 };
@@ -26,12 +26,18 @@ std::string THttpRequestBuilder::BuildHeadRequest(const std::string& host, const
     return data;
 }
 
-std::string THttpRequestBuilder::BuildGetWithRangeRequest(const std::string& host, const std::string& path, const int firstRangeByte, const int lastRangeByte) {
+std::string THttpRequestBuilder::BuildGetWithRangeRequest(
+        const std::string& host,
+        const std::string& path,
+        const size_t firstRangeByte,
+        const size_t lastRangeByte,
+        const std::string& validator) {
     std::string data;
     {
         AddRequestLine("GET", path, data);
         AddHost(host, data);
         AddKeepAlive(data);
+        AddIfRange(validator, data);
 
         data.append("Range: bytes=");
         data.append(std::to_string(firstRangeByte));
@@ -44,6 +50,33 @@ std::string THttpRequestBuilder::BuildGetWithRangeRequest(const std::string& hos
     return data;
 }
 
+std::string THttpRequestBuilder::BuildGetFromOffsetRequest(
+        const std::string& host,
+        const std::string& path,
+        const size_t firstRangeByte,
+        const std::string& validator) {
+    std::string data;
+    {
+        AddRequestLine("GET", path, data);
+        AddHost(host, data);
+        AddKeepAlive(data);
+        AddIfRange(validator, data);
+
+        data.append("Range: bytes=");
+        data.append(std::to_string(firstRangeByte));
+        data.append("-");
+        data.append("\r\n");
+        data.append("\r\n");
+    }
+
+    return data;
+}
+
+void THttpRequestBuilder::AddPriority(const size_t priority, std::string& request) {
+    // Before the empty line which ends the head.
+    request.insert(request.size() - 2, "X-Priority: " + std::to_string(priority) + "\r\n");
+}
+
 void THttpRequestBuilder::AddKeepAlive(std::string& request) {
     request.append("Connection: keep-alive");
     request.append("\r\n");
@@ -64,3 +97,13 @@ void THttpRequestBuilder::AddHost(const std::string& host, std::string& request)
     request.append(host);
     request.append("\r\n");
 }
+
+void THttpRequestBuilder::AddIfRange(const std::string& validator, std::string& request) {
+    if (validator.empty()) {
+        return;
+    }
+
+    request.append("If-Range: ");
+    request.append(validator);
+    request.append("\r\n");
+}
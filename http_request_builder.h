@@ -6,10 +6,24 @@ class THttpRequestBuilder {
 public:
     static std::string BuildGetRequest(const std::string& host, const std::string& path);
     static std::string BuildHeadRequest(const std::string& host, const std::string& path);
-    static std::string BuildGetWithRangeRequest(const std::string& host, const std::string& path, const int firstRangeByte, const int lastRangeByte);
+    // Empty validator means "no If-Range".
+    static std::string BuildGetFromOffsetRequest(
+            const std::string& host,
+            const std::string& path,
+            const size_t firstRangeByte,
+            const std::string& validator = std::string());
+    static std::string BuildGetWithRangeRequest(
+            const std::string& host,
+            const std::string& path,
+            const size_t firstRangeByte,
+            const size_t lastRangeByte,
+            const std::string& validator = std::string());
+    // Adds "X-Priority: <priority>" to a built request, the lruc daemon weights its transfer by it.
+    static void AddPriority(const size_t priority, std::string& request);
 
 private:
     static void AddKeepAlive(std::string& request);
     static void AddRequestLine(const std::string& requestType, const std::string& path, std::string& request);
     static void AddHost(const std::string& host, std::string& request);
+    static void AddIfRange(const std::string& validator, std::string& request);
 };
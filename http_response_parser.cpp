@@ -24,6 +24,56 @@ std::optional<size_t> THttpResponse::GetContentLength() const {
     return {};
 }
 
+std::optional<TContentRange> THttpResponse::GetContentRange() const {
+    // bytes <first>-<last>/<total>, bytes <first>-<last>/* or bytes */<total>
+    const std::optional<std::string_view> headerValue = GetHeaderValue("Content-Range");
+    if (!headerValue) {
+        return {};
+    }
+
+    std::string_view data = *headerValue;
+    const std::string_view unit = "bytes ";
+    if (data.compare(0, unit.size(), unit) != 0) {
+        return {};
+    }
+
+    data.remove_prefix(unit.size());
+
+    const size_t separatorPosition = data.find_first_of('/');
+    if (separatorPosition == std::string_view::npos) {
+        return {};
+    }
+
+    const std::string_view range = data.substr(0, separatorPosition);
+    const std::string_view total = data.substr(separatorPosition + 1);
+
+    TContentRange result;
+    if (range != "*") {
+        const size_t dashPosition = range.find_first_of('-');
+        if (dashPosition == std::string_view::npos) {
+            return {};
+        }
+
+        const std::from_chars_result firstConversionResult = std::from_chars(range.data(), range.data() + dashPosition, result.First);
+        const std::from_chars_result lastConversionResult = std::from_chars(range.data() + dashPosition + 1, range.data() + range.size(), result.Last);
+        if (firstConversionResult.ec != std::errc() || lastConversionResult.ec != std::errc()) {
+            return {};
+        }
+    }
+
+    if (total != "*") {
+        size_t totalValue = 0;
+        const std::from_chars_result conversionResult = std::from_chars(total.data(), total.data() + total.size(), totalValue);
+        if (conversionResult.ec != std::errc()) {
+            return {};
+        }
+
+        result.Total = totalValue;
+    }
+
+    return result;
+}
+
 std::optional<std::string_view> THttpResponse::GetHeaderValue(const std::string_view& name) const {
     const std::unordered_map<std::string_view, std::string_view>::const_iterator header = Headers.find(name);
     if (header != Headers.end()) {
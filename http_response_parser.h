@@ -1,12 +1,23 @@
 #pragma once
 
+#include "memory_budget.h"
+
 #include <optional>
 #include <string>
 #include <unordered_map>
 
+class TContentRange {
+public:
+    size_t First = 0;
+    size_t Last = 0;
+    // Empty when the server does not know the size ("bytes 0-99/*").
+    std::optional<size_t> Total;
+};
+
 class THttpResponse {
 public:
     std::optional<size_t> GetContentLength() const;
+    std::optional<TContentRange> GetContentRange() const;
     std::optional<std::string_view> GetHeaderValue(const std::string_view& name) const;
     bool HasHeaderAndValue(const std::string_view& name, const std::string_view& value) const;
 
@@ -20,6 +31,10 @@ public:
 
     std::string HeadRawData;
     std::string BodyRawData;
+
+    // Memory budget drawn for the raw data, given back with the response.
+    TMemoryBudget::TLease HeadLease;
+    TMemoryBudget::TLease BodyLease;
 };
 
 class THttpResponseParser {
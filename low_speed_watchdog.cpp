@@ -0,0 +1,39 @@
+#include "low_speed_watchdog.h"
+#include "error.h"
+
+TLowSpeedWatchdog::TLowSpeedWatchdog(const size_t limitBytesPerSecond, const std::chrono::milliseconds period)
+    : LimitBytesPerSecond(limitBytesPerSecond)
+    , Period(period)
+{
+    Reset(std::chrono::steady_clock::now());
+}
+
+void TLowSpeedWatchdog::Update(const size_t receivedBytes) {
+    if (LimitBytesPerSecond == 0 || Period == std::chrono::milliseconds::zero()) {
+        return;
+    }
+
+    PeriodReceivedBytes += receivedBytes;
+
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    const std::chrono::duration<double> elapsed = now - PeriodStart - Excluded;
+    if (elapsed < Period) {
+        return;
+    }
+
+    if (PeriodReceivedBytes < LimitBytesPerSecond * elapsed.count()) {
+        throw TError("Transfer is too slow", true);
+    }
+
+    Reset(now);
+}
+
+void TLowSpeedWatchdog::Exclude(const std::chrono::steady_clock::duration duration) {
+    Excluded += duration;
+}
+
+void TLowSpeedWatchdog::Reset(const std::chrono::steady_clock::time_point now) {
+    PeriodStart = now;
+    Excluded = std::chrono::steady_clock::duration::zero();
+    PeriodReceivedBytes = 0;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <chrono>
+
+// Aborts a transfer which receives less than the limit on average during the whole period.
+class TLowSpeedWatchdog {
+public:
+    // Zero limit or period disables the watchdog.
+    TLowSpeedWatchdog(const size_t limitBytesPerSecond, const std::chrono::milliseconds period);
+
+    void Update(const size_t receivedBytes);
+    // Time when the transfer was held back on purpose (by the rate limit) is not counted.
+    void Exclude(const std::chrono::steady_clock::duration duration);
+
+private:
+    void Reset(const std::chrono::steady_clock::time_point now);
+
+private:
+    const size_t LimitBytesPerSecond;
+    const std::chrono::milliseconds Period;
+
+    std::chrono::steady_clock::time_point PeriodStart;
+    std::chrono::steady_clock::duration Excluded;
+    size_t PeriodReceivedBytes = 0;
+};
@@ -1,21 +1,325 @@
+#include <chrono>
+#include <csignal>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <vector>
 
+#include "bandwidth_governor.h"
+#include "block_index.h"
+#include "download_service.h"
+#include "error.h"
 #include "http_file_downloader.h"
+#include "memory_budget.h"
+#include "memory_transport.h"
+#include "stream_sink.h"
+#include "traffic_trace.h"
 
-int main(int argc, char* argv[]) {
-    if (argc < 3) {
-        std::cout << "Try " << argv[0] << " <url> <output_file_name>" << std::endl;
-        return 0;
+size_t ParseSize(const std::string& value) {
+    size_t suffixPosition = 0;
+    size_t result = 0;
+    try {
+        result = std::stoull(value, &suffixPosition);
+    } catch (...) {
+        throw TError(value + " is not a valid size", false);
+    }
+
+    const std::string suffix = value.substr(suffixPosition);
+    if (suffix == "K" || suffix == "k") {
+        result *= 1024;
+    } else if (suffix == "M" || suffix == "m") {
+        result *= 1024 * 1024;
+    } else if (suffix == "G" || suffix == "g") {
+        result *= 1024 * 1024 * 1024;
+    } else if (!suffix.empty()) {
+        throw TError(value + " is not a valid size", false);
+    }
+
+    return result;
+}
+
+std::chrono::milliseconds ParseSeconds(const std::string& value) {
+    size_t suffixPosition = 0;
+    double result = 0;
+    try {
+        result = std::stod(value, &suffixPosition);
+    } catch (...) {
+        throw TError(value + " is not a valid number of seconds", false);
+    }
+
+    if (suffixPosition != value.size() || result < 0) {
+        throw TError(value + " is not a valid number of seconds", false);
     }
 
-    const std::string url(argv[1]);
-    const std::string outputFilePath(argv[2]);
+    return std::chrono::milliseconds(static_cast<long long>(result * 1000));
+}
+
+// The index is either a local file or a URL.
+TBlockIndex LoadBlockIndex(const std::string& location, const TDownloadOptions& options) {
+    std::string data;
+    if (location.find("://") != std::string::npos) {
+        TStreamSink sink([&data](const std::string_view& part) {
+            data.append(part);
+        });
+
+        THttpFileDownloader downloader(location, options);
+        downloader.Download(sink);
+        sink.Close();
+    } else {
+        std::ifstream input(location, std::ios::binary);
+        if (!input) {
+            throw TError("Cannot open " + location, false);
+        }
+
+        std::ostringstream content;
+        content << input.rdbuf();
+        data = content.str();
+    }
+
+    return TBlockIndex::Parse(data);
+}
+
+void PrintUsage(const char* programName) {
+    std::cout << "Try " << programName << " [options] <url> <output_file_name>" << std::endl;
+    std::cout << "Use - as output_file_name to write to standard output." << std::endl;
+    std::cout << "Or " << programName << " --make-index [--block-size <bytes>] <file> <index_file>" << std::endl;
+    std::cout << "to publish block checksums of the file for delta downloads." << std::endl;
+    std::cout << "Or " << programName << " [options] --daemon <socket_path> --cache-dir <directory>" << std::endl;
+    std::cout << "to serve GET /<url> over a Unix domain socket, sharing downloads between clients." << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --limit-rate <bytes/s>              limit total receive rate (K, M, G suffixes allowed)" << std::endl;
+    std::cout << "  --host-limit-rate <host>=<bytes/s>  limit receive rate from the host" << std::endl;
+    std::cout << "  --priority <weight>                 share of the limited bandwidth, default 1" << std::endl;
+    std::cout << "  --connections <count>               connections fetching ranges of a big file in parallel" << std::endl;
+    std::cout << "  --connect-timeout <seconds>         limit connection time, 0 to wait forever, default 30" << std::endl;
+    std::cout << "  --timeout <seconds>                 limit every send and receive, 0 to wait forever, default 60" << std::endl;
+    std::cout << "  --speed-limit <bytes/s>             abort a transfer slower than this during --speed-time" << std::endl;
+    std::cout << "  --speed-time <seconds>              period of --speed-limit, default 30" << std::endl;
+    std::cout << "  --retries <count>                   retries of a failed request, default 4" << std::endl;
+    std::cout << "  --retry-deadline <seconds>          stop retrying after this time since the download start, 0 for no limit" << std::endl;
+    std::cout << "  --direct-io                         write the output bypassing the page cache" << std::endl;
+    std::cout << "  --memory-limit <bytes>              limit memory taken by buffers of all transfers" << std::endl;
+    std::cout << "  --memory-stats                      print current and peak buffer memory on exit" << std::endl;
+    std::cout << "  --tls-stats                         print TLS handshakes, resumed ones and kTLS connections on exit" << std::endl;
+    std::cout << "  --delta-base <file>                 older copy of the file, only the changed blocks are fetched" << std::endl;
+    std::cout << "  --delta-index <file or url>         block checksums of the new file made by --make-index" << std::endl;
+    std::cout << "  --cacert <file>                     trust certificates from the file in addition to the system ones" << std::endl;
+    std::cout << "  --insecure                          do not verify the server certificate" << std::endl;
+    std::cout << "  --record-trace <file>               save the traffic to replay it later" << std::endl;
+    std::cout << "  --replay-trace <file>               answer requests from the saved traffic, no network involved" << std::endl;
+    std::cout << "  --replay-read-size <bytes>          largest read from a replayed connection, default unlimited" << std::endl;
+    std::cout << "  --replay-random-reads               replayed reads of random size up to --replay-read-size" << std::endl;
+    std::cout << "  --daemon <socket_path>              run as a local download service" << std::endl;
+    std::cout << "  --cache-dir <directory>             where the service keeps downloads" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    // OpenSSL writes to the socket itself, and a closed stdout should fail the write as well.
+    signal(SIGPIPE, SIG_IGN);
 
     try {
-        THttpFileDownloader downloader(url);
-        downloader.Download(outputFilePath);
-        std::cout << "OK" << std::endl;
+        TDownloadOptions options;
+        std::vector<std::string> arguments;
+        std::string daemonSocketPath;
+        std::string cacheDirectory;
+        std::string recordTracePath;
+        std::string replayTracePath;
+        TReadFragmentation replayFragmentation;
+        TTlsOptions tlsOptions;
+        bool isMakeIndex = false;
+        bool isPrintMemoryStats = false;
+        bool isPrintTlsStats = false;
+        size_t blockSize = TBlockIndex::DefaultBlockSizeBytes;
+        std::string deltaBasePath;
+        std::string deltaIndexLocation;
+
+        for (int i = 1; i < argc; ++i) {
+            const std::string argument(argv[i]);
+            if (argument.size() < 2 || argument.compare(0, 2, "--") != 0) {
+                arguments.push_back(argument);
+                continue;
+            }
+
+            if (argument == "--direct-io") {
+                options.DirectIo = true;
+                continue;
+            }
+
+            if (argument == "--tls-stats") {
+                isPrintTlsStats = true;
+                continue;
+            }
+
+            if (argument == "--memory-stats") {
+                isPrintMemoryStats = true;
+                continue;
+            }
+
+            if (argument == "--make-index") {
+                isMakeIndex = true;
+                continue;
+            }
+
+            if (argument == "--insecure") {
+                tlsOptions.VerifyPeer = false;
+                continue;
+            }
+
+            if (argument == "--replay-random-reads") {
+                replayFragmentation.IsRandom = true;
+                continue;
+            }
+
+            if (i + 1 >= argc) {
+                throw TError(argument + " requires a value", false);
+            }
+
+            const std::string value(argv[++i]);
+            if (argument == "--limit-rate") {
+                TBandwidthGovernor::Instance().SetGlobalLimit(ParseSize(value));
+            } else if (argument == "--memory-limit") {
+                TMemoryBudget::Instance().SetLimit(ParseSize(value));
+            } else if (argument == "--host-limit-rate") {
+                const size_t separatorPosition = value.find('=');
+                if (separatorPosition == std::string::npos) {
+                    throw TError(argument + " expects <host>=<bytes/s>", false);
+                }
+
+                TBandwidthGovernor::Instance().SetHostLimit(value.substr(0, separatorPosition), ParseSize(value.substr(separatorPosition + 1)));
+            } else if (argument == "--priority") {
+                options.Priority = ParseSize(value);
+            } else if (argument == "--connections") {
+                options.ParallelConnections = ParseSize(value);
+            } else if (argument == "--connect-timeout") {
+                options.Connection.ConnectTimeout = ParseSeconds(value);
+            } else if (argument == "--timeout") {
+                options.Connection.OperationTimeout = ParseSeconds(value);
+            } else if (argument == "--speed-limit") {
+                options.Connection.LowSpeedLimitBytesPerSecond = ParseSize(value);
+            } else if (argument == "--speed-time") {
+                options.Connection.LowSpeedTime = ParseSeconds(value);
+            } else if (argument == "--retries") {
+                options.Retry.MaxTryCount = ParseSize(value) + 1;
+            } else if (argument == "--retry-deadline") {
+                options.Retry.Deadline = ParseSeconds(value);
+            } else if (argument == "--block-size") {
+                blockSize = ParseSize(value);
+            } else if (argument == "--delta-base") {
+                deltaBasePath = value;
+            } else if (argument == "--delta-index") {
+                deltaIndexLocation = value;
+            } else if (argument == "--cacert") {
+                tlsOptions.CaFile = value;
+            } else if (argument == "--record-trace") {
+                recordTracePath = value;
+            } else if (argument == "--replay-trace") {
+                replayTracePath = value;
+            } else if (argument == "--replay-read-size") {
+                replayFragmentation.MaxReadSize = ParseSize(value);
+            } else if (argument == "--daemon") {
+                daemonSocketPath = value;
+            } else if (argument == "--cache-dir") {
+                cacheDirectory = value;
+            } else {
+                throw TError("Unknown option " + argument, false);
+            }
+        }
+
+        if (!tlsOptions.VerifyPeer || !tlsOptions.CaFile.empty()) {
+            options.Connection.TlsContext = std::make_shared<TTlsContext>(tlsOptions);
+        }
+
+        if (!daemonSocketPath.empty()) {
+            if (cacheDirectory.empty()) {
+                throw TError("--daemon requires --cache-dir", false);
+            }
+
+            TDownloadService service(daemonSocketPath, cacheDirectory, options);
+            service.Run();
+            return 0;
+        }
+
+        if (arguments.size() < 2) {
+            PrintUsage(argv[0]);
+            return 0;
+        }
+
+        if (isMakeIndex) {
+            const std::string index = TBlockIndex::Build(arguments[0], blockSize).Serialize();
+
+            std::ofstream output(arguments[1], std::ios::binary | std::ios::trunc);
+            if (!output.write(index.data(), index.size()).flush()) {
+                throw TError("Cannot write " + arguments[1], false);
+            }
+
+            std::cout << "OK" << std::endl;
+            return 0;
+        }
+
+        if (deltaBasePath.empty() != deltaIndexLocation.empty()) {
+            throw TError("--delta-base and --delta-index go together", false);
+        }
+
+        const std::string& url = arguments[0];
+        const std::string& outputFilePath = arguments[1];
+
+        std::shared_ptr<TTrafficTrace> trace;
+        if (!replayTracePath.empty()) {
+            trace = TTrafficTrace::Load(replayTracePath);
+            options.TransportFactory = [trace, replayFragmentation](const TEndpoint&) {
+                return std::make_unique<TMemoryTransport>(
+                        [trace](const std::string& request) {
+                            return trace->Respond(request);
+                        },
+                        replayFragmentation);
+            };
+        } else if (!recordTracePath.empty()) {
+            trace = TTrafficTrace::Create(recordTracePath);
+            const TConnectionOptions& connectionOptions = options.Connection;
+            options.TransportFactory = [trace, connectionOptions](const TEndpoint& endpoint) {
+                return std::make_unique<TRecordingTransport>(THttpConnection::CreateTransport(endpoint, connectionOptions), trace);
+            };
+        }
+
+        const auto download = [&]() {
+            THttpFileDownloader downloader(url, options);
+            if (deltaBasePath.empty()) {
+                downloader.Download(outputFilePath);
+                return;
+            }
+
+            const TBlockIndex index = LoadBlockIndex(deltaIndexLocation, options);
+            const size_t fetchedBytes = downloader.DownloadDelta(outputFilePath, deltaBasePath, index);
+            std::cout << "Fetched " << fetchedBytes << " of " << index.Size << " bytes" << std::endl;
+        };
+
+        const auto printStats = [&]() {
+            if (isPrintMemoryStats) {
+                const TMemoryBudget& budget = TMemoryBudget::Instance();
+                std::cerr << "Buffer memory: " << budget.GetUsage() << " bytes now, " << budget.GetPeakUsage() << " bytes at peak" << std::endl;
+            }
+
+            if (isPrintTlsStats) {
+                const std::shared_ptr<TTlsContext> context = options.Connection.TlsContext ? options.Connection.TlsContext : TTlsContext::GetDefault();
+                std::cerr << "TLS handshakes: " << context->GetHandshakeCount()
+                          << ", resumed: " << context->GetResumedHandshakeCount()
+                          << ", kTLS: " << context->GetKernelTlsCount() << std::endl;
+            }
+        };
+
+        try {
+            download();
+        } catch (...) {
+            printStats();
+            throw;
+        }
+
+        printStats();
+
+        if (outputFilePath != "-") {
+            std::cout << "OK" << std::endl;
+        }
 
         return 0;
     } catch (const std::exception& error) {
@@ -0,0 +1,147 @@
+#include "memory_budget.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+TMemoryBudget::TLease::TLease(TMemoryBudget& budget, const size_t size)
+    : Budget(&budget)
+    , Size(size)
+{
+}
+
+TMemoryBudget::TLease::TLease(TLease&& other) noexcept
+    : Budget(std::exchange(other.Budget, nullptr))
+    , Size(std::exchange(other.Size, 0))
+{
+}
+
+TMemoryBudget::TLease& TMemoryBudget::TLease::operator=(TLease&& other) noexcept {
+    if (this != &other) {
+        Release();
+
+        Budget = std::exchange(other.Budget, nullptr);
+        Size = std::exchange(other.Size, 0);
+    }
+
+    return *this;
+}
+
+TMemoryBudget::TLease::~TLease() {
+    Release();
+}
+
+void TMemoryBudget::TLease::Resize(const size_t size) {
+    if (!Budget) {
+        Budget = &TMemoryBudget::Instance();
+    }
+
+    if (size > Size) {
+        Budget->Give(Size);
+        Size = 0;
+        Budget->Take(size, size, Size);
+    } else {
+        Budget->Give(Size - size);
+        Size = size;
+    }
+}
+
+void TMemoryBudget::TLease::Release() {
+    if (Budget) {
+        Budget->Give(Size);
+    }
+
+    Budget = nullptr;
+    Size = 0;
+}
+
+size_t TMemoryBudget::TLease::GetSize() const {
+    return Size;
+}
+
+TMemoryBudget& TMemoryBudget::Instance() {
+    static TMemoryBudget budget;
+    return budget;
+}
+
+void TMemoryBudget::SetLimit(const size_t bytes) {
+    std::unique_lock<std::mutex> lock(Mutex);
+    Limit = bytes;
+    Condition.notify_all();
+}
+
+TMemoryBudget::TLease TMemoryBudget::Acquire(const size_t size) {
+    return AcquireUpTo(size, size);
+}
+
+TMemoryBudget::TLease TMemoryBudget::AcquireUpTo(const size_t minSize, const size_t preferredSize) {
+    size_t taken = 0;
+    Take(minSize, std::max(minSize, preferredSize), taken);
+
+    return TLease(*this, taken);
+}
+
+bool TMemoryBudget::TryAcquire(const size_t size, TLease& lease) {
+    {
+        std::unique_lock<std::mutex> lock(Mutex);
+        if (Limit > 0 && Usage + size > Limit) {
+            return false;
+        }
+
+        Usage += size;
+        PeakUsage = std::max(PeakUsage, Usage);
+    }
+
+    lease = TLease(*this, size);
+    return true;
+}
+
+size_t TMemoryBudget::GetLimit() const {
+    std::unique_lock<std::mutex> lock(Mutex);
+    return Limit;
+}
+
+size_t TMemoryBudget::GetAvailable() const {
+    std::unique_lock<std::mutex> lock(Mutex);
+    if (Limit == 0) {
+        return std::numeric_limits<size_t>::max();
+    }
+
+    return Limit > Usage ? Limit - Usage : 0;
+}
+
+size_t TMemoryBudget::GetUsage() const {
+    std::unique_lock<std::mutex> lock(Mutex);
+    return Usage;
+}
+
+size_t TMemoryBudget::GetPeakUsage() const {
+    std::unique_lock<std::mutex> lock(Mutex);
+    return PeakUsage;
+}
+
+void TMemoryBudget::Take(const size_t minSize, const size_t preferredSize, size_t& taken) {
+    std::unique_lock<std::mutex> lock(Mutex);
+
+    Condition.wait(lock, [&]() {
+        return Limit == 0 || Usage + minSize <= Limit || Usage == 0;
+    });
+
+    taken = preferredSize;
+    if (Limit > 0 && Usage + preferredSize > Limit) {
+        taken = std::max(minSize, Limit > Usage ? Limit - Usage : 0);
+    }
+
+    Usage += taken;
+    PeakUsage = std::max(PeakUsage, Usage);
+}
+
+void TMemoryBudget::Give(const size_t size) {
+    if (size == 0) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(Mutex);
+    Usage -= size;
+    Condition.notify_all();
+}
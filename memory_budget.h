@@ -0,0 +1,73 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+
+// Process-wide limit on memory taken by transfer buffers. Buffers are
+// allocated only after their size is drawn from the budget, and when it
+// runs out transfers wait for others to give memory back instead of
+// allocating more.
+class TMemoryBudget {
+public:
+    // Memory drawn from the budget, given back when the lease is destroyed.
+    class TLease {
+    public:
+        TLease() = default;
+        TLease(TLease&& other) noexcept;
+        TLease& operator=(TLease&& other) noexcept;
+        ~TLease();
+
+        TLease(const TLease&) = delete;
+        TLease& operator=(const TLease&) = delete;
+
+        // Takes more memory (waiting for it) or gives the excess back. While waiting
+        // nothing is held, so that growing leases do not wait on each other.
+        void Resize(const size_t size);
+        void Release();
+
+        size_t GetSize() const;
+
+    private:
+        friend class TMemoryBudget;
+
+        TLease(TMemoryBudget& budget, const size_t size);
+
+    private:
+        TMemoryBudget* Budget = nullptr;
+        size_t Size = 0;
+    };
+
+public:
+    static TMemoryBudget& Instance();
+
+    // Zero means "unlimited".
+    void SetLimit(const size_t bytes);
+
+    // Waits until the size is available. A size above the limit is granted
+    // when nothing else is drawn from the budget, so that it does not wait forever.
+    TLease Acquire(const size_t size);
+    // Waits until at least minSize is available and takes up to preferredSize,
+    // so buffers shrink under pressure instead of waiting.
+    TLease AcquireUpTo(const size_t minSize, const size_t preferredSize);
+    // Takes the size only if it is available right away, for those who may not
+    // wait while holding something else.
+    bool TryAcquire(const size_t size, TLease& lease);
+
+    size_t GetLimit() const;
+    // The largest size_t when unlimited.
+    size_t GetAvailable() const;
+    size_t GetUsage() const;
+    size_t GetPeakUsage() const;
+
+private:
+    void Take(const size_t minSize, const size_t preferredSize, size_t& taken);
+    void Give(const size_t size);
+
+private:
+    mutable std::mutex Mutex;
+    std::condition_variable Condition;
+
+    size_t Limit = 0;
+    size_t Usage = 0;
+    size_t PeakUsage = 0;
+};
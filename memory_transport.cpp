@@ -0,0 +1,79 @@
+#include "memory_transport.h"
+#include "error.h"
+
+#include <algorithm>
+#include <cstring>
+
+TMemoryTransport::TMemoryTransport(TResponder responder, const TReadFragmentation& fragmentation)
+    : Responder(std::move(responder))
+    , Fragmentation(fragmentation)
+    , Random(fragmentation.Seed)
+{
+}
+
+void TMemoryTransport::Send(const std::string& data) {
+    CheckConnectionIsGood();
+
+    // Whatever has been consumed is dropped, so a long keep-alive session does not grow.
+    Incoming.erase(0, Position);
+    Delivered -= Position;
+    Position = 0;
+
+    Incoming.append(Responder(data));
+}
+
+int TMemoryTransport::ReceiveChunk(void* result, const int estimatedSize) {
+    CheckConnectionIsGood();
+
+    const size_t size = Deliver(estimatedSize);
+    memcpy(result, Incoming.data() + Position, size);
+    Position += size;
+
+    return size;
+}
+
+int TMemoryTransport::PeekChunk(void* result, const int estimatedSize) {
+    CheckConnectionIsGood();
+
+    const size_t size = Deliver(estimatedSize);
+    memcpy(result, Incoming.data() + Position, size);
+
+    return size;
+}
+
+void TMemoryTransport::Shutdown() {
+    IsShutdown = true;
+}
+
+bool TMemoryTransport::IsGood() const {
+    return !IsShutdown;
+}
+
+size_t TMemoryTransport::Deliver(const size_t estimatedSize) {
+    // Like a socket buffer: a read gets what has arrived, and only an empty buffer waits for the next fragment.
+    // Nothing left to deliver looks like the server has closed the connection.
+    if (Delivered == Position && Delivered < Incoming.size()) {
+        Delivered += std::min(GetNextFragmentSize(), Incoming.size() - Delivered);
+    }
+
+    return std::min(estimatedSize, Delivered - Position);
+}
+
+size_t TMemoryTransport::GetNextFragmentSize() {
+    if (Fragmentation.IsRandom) {
+        const size_t maxReadSize = Fragmentation.MaxReadSize > 0 ? Fragmentation.MaxReadSize : DefaultRandomReadSize;
+        return std::uniform_int_distribution<size_t>(1, maxReadSize)(Random);
+    }
+
+    if (Fragmentation.MaxReadSize > 0) {
+        return Fragmentation.MaxReadSize;
+    }
+
+    return Incoming.size() - Delivered;
+}
+
+void TMemoryTransport::CheckConnectionIsGood() const {
+    if (!IsGood()) {
+        throw TError("Attempt to use bad connection", true);
+    }
+}
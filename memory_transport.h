@@ -0,0 +1,57 @@
+#pragma once
+
+#include "transport.h"
+
+#include <atomic>
+#include <functional>
+#include <random>
+#include <string>
+
+// How the incoming stream is cut into reads, the way a socket would deliver it.
+class TReadFragmentation {
+public:
+    // Zero means "as much as asked for".
+    size_t MaxReadSize = 0;
+    // Reads of random size between 1 and MaxReadSize, the same for the same seed.
+    bool IsRandom = false;
+    uint64_t Seed = 1;
+};
+
+// Transport without a kernel underneath: the server side is a function from
+// a request to the bytes sent in reply, so parsing and body reading can be
+// exercised and measured in isolation.
+class TMemoryTransport : public TTransport {
+public:
+    using TResponder = std::function<std::string(const std::string&)>;
+
+public:
+    TMemoryTransport(TResponder responder, const TReadFragmentation& fragmentation = TReadFragmentation());
+
+    virtual void Send(const std::string& data) override;
+    virtual int ReceiveChunk(void* result, const int estimatedSize) override;
+    virtual int PeekChunk(void* result, const int estimatedSize) override;
+
+    virtual void Shutdown() override;
+
+    virtual bool IsGood() const override;
+
+private:
+    // Returns how many bytes a read may return, delivering the next fragment when needed.
+    size_t Deliver(const size_t estimatedSize);
+    size_t GetNextFragmentSize();
+
+    void CheckConnectionIsGood() const;
+
+private:
+    const TResponder Responder;
+    const TReadFragmentation Fragmentation;
+    std::mt19937_64 Random;
+
+    std::string Incoming;
+    size_t Position = 0;
+    size_t Delivered = 0;
+
+    std::atomic<bool> IsShutdown{false};
+
+    static const size_t DefaultRandomReadSize = 64 * 1024;
+};
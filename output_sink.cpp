@@ -0,0 +1,7 @@
+#include "output_sink.h"
+
+void TOutputSink::Allocate(const size_t /*size*/) {
+}
+
+void TOutputSink::Cancel() {
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string_view>
+
+// Destination of the downloaded content. Parts of the content may be written
+// from several threads and in any order.
+class TOutputSink {
+public:
+    virtual ~TOutputSink() = default;
+
+    // Called once the size of the content is known.
+    virtual void Allocate(const size_t size);
+    virtual void WriteAt(const size_t offset, const std::string_view& data) = 0;
+    // Wakes up writers blocked in WriteAt, they fail instead of waiting forever.
+    virtual void Cancel();
+    virtual void Close() = 0;
+};
@@ -0,0 +1,119 @@
+#include "range_scheduler.h"
+
+#include <algorithm>
+
+TRangeScheduler::TRangeScheduler(const size_t firstByte, const size_t resourceSize, const size_t rangeSizeBytes)
+    : NextByteToFetch(firstByte)
+    , ResourceSize(resourceSize)
+    , RangeSizeBytes(rangeSizeBytes)
+{
+}
+
+std::shared_ptr<TRangeScheduler::TRange> TRangeScheduler::Next() {
+    std::unique_lock<std::mutex> lock(Mutex);
+
+    while (true) {
+        if (Cancelled) {
+            return nullptr;
+        }
+
+        const TClock::time_point now = TClock::now();
+
+        if (NextByteToFetch < ResourceSize) {
+            std::shared_ptr<TRange> range = std::make_shared<TRange>();
+            {
+                range->FirstByte = NextByteToFetch;
+                range->LastByte = std::min(NextByteToFetch + RangeSizeBytes, ResourceSize) - 1;
+                range->StartTime = now;
+            }
+
+            NextByteToFetch = range->LastByte + 1;
+            InFlight.push_back(range);
+
+            return range;
+        }
+
+        while (!InFlight.empty() && InFlight.front()->IsDone) {
+            InFlight.pop_front();
+        }
+
+        if (InFlight.empty()) {
+            return nullptr;
+        }
+
+        std::shared_ptr<TRange> lateRange = FindLateRange(now);
+        if (lateRange) {
+            lateRange->IsHedged = true;
+            return lateRange;
+        }
+
+        Condition.wait_for(lock, HedgeCheckInterval);
+    }
+}
+
+bool TRangeScheduler::Attach(TRange& range, THttpConnection& connection) {
+    std::unique_lock<std::mutex> lock(Mutex);
+    if (range.IsDone) {
+        return false;
+    }
+
+    range.Connections.push_back(&connection);
+    return true;
+}
+
+void TRangeScheduler::Detach(TRange& range, THttpConnection& connection) {
+    std::unique_lock<std::mutex> lock(Mutex);
+    range.Connections.erase(std::remove(range.Connections.begin(), range.Connections.end(), &connection), range.Connections.end());
+}
+
+bool TRangeScheduler::Complete(TRange& range, const TClock::duration fetchDuration) {
+    std::unique_lock<std::mutex> lock(Mutex);
+    if (range.IsDone) {
+        return false;
+    }
+
+    range.IsDone = true;
+    for (THttpConnection* connection : range.Connections) {
+        connection->Abort();
+    }
+
+    CompletedBytes += range.LastByte - range.FirstByte + 1;
+    CompletedDuration += fetchDuration;
+
+    Condition.notify_all();
+    return true;
+}
+
+bool TRangeScheduler::IsDone(const TRange& range) {
+    std::unique_lock<std::mutex> lock(Mutex);
+    return range.IsDone;
+}
+
+void TRangeScheduler::Cancel() {
+    std::unique_lock<std::mutex> lock(Mutex);
+    Cancelled = true;
+    Condition.notify_all();
+}
+
+std::shared_ptr<TRangeScheduler::TRange> TRangeScheduler::FindLateRange(const TClock::time_point now) const {
+    // Nothing to compare with until some range is fetched.
+    if (CompletedBytes == 0) {
+        return nullptr;
+    }
+
+    const double bytesPerTick = static_cast<double>(CompletedBytes) / std::max<TClock::rep>(CompletedDuration.count(), 1);
+
+    for (const std::shared_ptr<TRange>& range : InFlight) {
+        if (range->IsDone || range->IsHedged) {
+            continue;
+        }
+
+        const TClock::duration expectedDuration(static_cast<TClock::rep>((range->LastByte - range->FirstByte + 1) / bytesPerTick));
+        const TClock::duration elapsed = now - range->StartTime;
+        if (elapsed > MinHedgeDelay && elapsed > expectedDuration * HedgeDelayFactor) {
+            return range;
+        }
+    }
+
+    return nullptr;
+}
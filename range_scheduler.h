@@ -0,0 +1,73 @@
+#pragma once
+
+#include "http_connection.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Hands out ranges of a resource to the connections fetching it in parallel.
+// When there are no new ranges left, idle connections get a copy of a range
+// which takes much longer than the finished ones did (hedging); the copy which
+// completes first wins and the others are aborted.
+class TRangeScheduler {
+public:
+    using TClock = std::chrono::steady_clock;
+
+    class TRange {
+    public:
+        size_t FirstByte = 0;
+        size_t LastByte = 0;
+
+    private:
+        friend class TRangeScheduler;
+
+        TClock::time_point StartTime;
+        bool IsDone = false;
+        bool IsHedged = false;
+        std::vector<THttpConnection*> Connections;
+    };
+
+public:
+    TRangeScheduler(const size_t firstByte, const size_t resourceSize, const size_t rangeSizeBytes);
+
+    // Blocks while all ranges are in progress and none of them is late.
+    // Returns nullptr when there is nothing left to fetch.
+    std::shared_ptr<TRange> Next();
+
+    // The connection is aborted when another copy of the range wins.
+    // Returns false when the range is already fetched.
+    bool Attach(TRange& range, THttpConnection& connection);
+    void Detach(TRange& range, THttpConnection& connection);
+
+    // Returns false when another copy of the range has won.
+    bool Complete(TRange& range, const TClock::duration fetchDuration);
+    bool IsDone(const TRange& range);
+
+    // Stops handing out ranges.
+    void Cancel();
+
+private:
+    std::shared_ptr<TRange> FindLateRange(const TClock::time_point now) const;
+
+private:
+    std::mutex Mutex;
+    std::condition_variable Condition;
+
+    size_t NextByteToFetch;
+    const size_t ResourceSize;
+    const size_t RangeSizeBytes;
+    bool Cancelled = false;
+
+    std::deque<std::shared_ptr<TRange>> InFlight;
+
+    size_t CompletedBytes = 0;
+    TClock::duration CompletedDuration = TClock::duration::zero();
+
+    static constexpr double HedgeDelayFactor = 3.0;
+    static constexpr std::chrono::milliseconds MinHedgeDelay = std::chrono::seconds(1);
+    static constexpr std::chrono::milliseconds HedgeCheckInterval = std::chrono::milliseconds(100);
+};
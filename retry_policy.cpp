@@ -0,0 +1,42 @@
+#include "retry_policy.h"
+#include "error.h"
+
+#include <algorithm>
+#include <random>
+#include <thread>
+
+std::chrono::milliseconds GetBackoff(const TRetryPolicy& policy, const size_t retryNumber) {
+    thread_local std::mt19937_64 generator(std::random_device{}());
+
+    std::chrono::milliseconds maxBackoff = policy.MaxBackoff;
+    if (retryNumber <= 32) {
+        maxBackoff = std::min<std::chrono::milliseconds>(maxBackoff, policy.InitialBackoff * (1ll << (retryNumber - 1)));
+    }
+
+    std::uniform_int_distribution<long long> distribution(0, maxBackoff.count());
+    return std::chrono::milliseconds(distribution(generator));
+}
+
+void DoWithRetry(const std::function<void()>& action, const TRetryPolicy& policy) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t tryCount = 1;
+
+    while (true) {
+        try {
+            action();
+            break;
+        } catch (const TError& error) {
+            if (!error.IsNeedRetry() || tryCount >= policy.MaxTryCount) {
+                throw;
+            }
+
+            const std::chrono::milliseconds backoff = GetBackoff(policy, tryCount);
+            if (policy.Deadline != std::chrono::milliseconds::zero() && std::chrono::steady_clock::now() + backoff - start > policy.Deadline) {
+                throw;
+            }
+
+            std::this_thread::sleep_for(backoff);
+            ++tryCount;
+        }
+    }
+}
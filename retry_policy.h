@@ -0,0 +1,20 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+
+class TRetryPolicy {
+public:
+    size_t MaxTryCount = 5;
+
+    // The delay before the n-th retry is random, up to InitialBackoff * 2^(n - 1)
+    // but not more than MaxBackoff, so that clients failed together do not retry together.
+    std::chrono::milliseconds InitialBackoff = std::chrono::milliseconds(500);
+    std::chrono::milliseconds MaxBackoff = std::chrono::seconds(30);
+
+    // No retry is started after the deadline, zero means "no deadline".
+    std::chrono::milliseconds Deadline = std::chrono::milliseconds::zero();
+};
+
+// Repeats the action while it fails with a TError which needs retry.
+void DoWithRetry(const std::function<void()>& action, const TRetryPolicy& policy);
@@ -0,0 +1,183 @@
+#include "socket_connection.h"
+#include "error.h"
+#include "tcp_connection.h"
+#include "unix_socket_connection.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+TSocketConnection::TSocketConnection(const std::chrono::milliseconds connectTimeout, const std::chrono::milliseconds operationTimeout)
+    : ConnectTimeout(connectTimeout)
+    , OperationTimeout(operationTimeout)
+{
+}
+
+TSocketConnection::~TSocketConnection() {
+    Close();
+}
+
+std::unique_ptr<TSocketConnection> TSocketConnection::Create(
+        const TEndpoint& endpoint,
+        const std::chrono::milliseconds connectTimeout,
+        const std::chrono::milliseconds operationTimeout) {
+    if (!endpoint.UnixSocketPath.empty()) {
+        return std::make_unique<TUnixSocketConnection>(endpoint.UnixSocketPath, connectTimeout, operationTimeout);
+    }
+
+    return std::make_unique<TTcpConnection>(endpoint.Host, endpoint.Port, connectTimeout, operationTimeout);
+}
+
+void TSocketConnection::Send(const std::string& data) {
+    CheckConnectionIsGood();
+
+    size_t totalBytesSended = 0;
+    while (totalBytesSended < data.size()) {
+        WaitForReadiness(POLLOUT);
+
+        const int bytesSended = send(SocketDecriptor, data.c_str() + totalBytesSended, data.size() - totalBytesSended, SendFlags);
+        if (bytesSended < 0) {
+            Good = false;
+            throw TError("Cannot send data", true);
+        }
+
+        totalBytesSended += bytesSended;
+    }
+}
+
+int TSocketConnection::ReceiveChunk(void* result, const int estimatedSize) {
+    CheckConnectionIsGood();
+    WaitForReadiness(POLLIN);
+
+    const int bytesReceived = recv(SocketDecriptor, result, estimatedSize, 0);
+    if (bytesReceived < 0) {
+        Good = false;
+        throw TError("Cannot receive data", true);
+    }
+
+    return bytesReceived;
+}
+
+int TSocketConnection::PeekChunk(void* result, const int estimatedSize) {
+    CheckConnectionIsGood();
+    WaitForReadiness(POLLIN);
+
+    const int bytesReceived = recv(SocketDecriptor, result, estimatedSize, MSG_PEEK);
+    if (bytesReceived < 0) {
+        Good = false;
+        throw TError("Cannot peek data", true);
+    }
+
+    return bytesReceived;
+}
+
+void TSocketConnection::Shutdown() {
+    Good = false;
+    shutdown(SocketDecriptor, SHUT_RDWR);
+}
+
+int TSocketConnection::GetDescriptor() const {
+    return SocketDecriptor;
+}
+
+void TSocketConnection::SetDescriptorTimeouts() {
+    if (OperationTimeout == std::chrono::milliseconds::zero()) {
+        return;
+    }
+
+    struct timeval timeout;
+    {
+        timeout.tv_sec = OperationTimeout.count() / 1000;
+        timeout.tv_usec = (OperationTimeout.count() % 1000) * 1000;
+    }
+
+    setsockopt(SocketDecriptor, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(SocketDecriptor, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+bool TSocketConnection::IsGood() const {
+    return Good;
+}
+
+bool TSocketConnection::Connect(const struct sockaddr* address, const socklen_t addressLength) {
+    if (ConnectTimeout == std::chrono::milliseconds::zero()) {
+        return connect(SocketDecriptor, address, addressLength) != -1;
+    }
+
+    // Non-blocking connect is the only way to limit the time it takes.
+    const int flags = fcntl(SocketDecriptor, F_GETFL, 0);
+    fcntl(SocketDecriptor, F_SETFL, flags | O_NONBLOCK);
+
+    int connectResult = connect(SocketDecriptor, address, addressLength);
+    if (connectResult == -1 && errno == EINPROGRESS) {
+        struct pollfd descriptor;
+        {
+            descriptor.fd = SocketDecriptor;
+            descriptor.events = POLLOUT;
+            descriptor.revents = 0;
+        }
+
+        int pollResult = 0;
+        do {
+            pollResult = poll(&descriptor, 1, ConnectTimeout.count());
+        } while (pollResult < 0 && errno == EINTR);
+
+        int error = 0;
+        socklen_t errorLength = sizeof(error);
+        if (pollResult == 1 && getsockopt(SocketDecriptor, SOL_SOCKET, SO_ERROR, &error, &errorLength) == 0 && error == 0) {
+            connectResult = 0;
+        }
+    }
+
+    fcntl(SocketDecriptor, F_SETFL, flags);
+
+    return connectResult == 0;
+}
+
+void TSocketConnection::Close() {
+    if (SocketDecriptor != -1) {
+        close(SocketDecriptor);
+        SocketDecriptor = -1;
+    }
+
+    Good = false;
+}
+
+void TSocketConnection::WaitForReadiness(const short events) {
+    if (OperationTimeout == std::chrono::milliseconds::zero()) {
+        return;
+    }
+
+    struct pollfd descriptor;
+    {
+        descriptor.fd = SocketDecriptor;
+        descriptor.events = events;
+        descriptor.revents = 0;
+    }
+
+    int pollResult = 0;
+    do {
+        pollResult = poll(&descriptor, 1, OperationTimeout.count());
+    } while (pollResult < 0 && errno == EINTR);
+
+    if (pollResult < 0) {
+        Good = false;
+        throw TError("Cannot wait for socket", true);
+    }
+
+    if (pollResult == 0) {
+        Good = false;
+        throw TError("Operation timed out", true);
+    }
+}
+
+void TSocketConnection::CheckConnectionIsGood() const {
+    if (!IsGood()) {
+        throw TError("Attempt to use bad connection", true);
+    }
+}
+
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "transport.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+
+// Where the server listens: a TCP host and port or a Unix domain socket.
+class TEndpoint {
+public:
+    std::string Host;
+    std::string Port;
+    // Used instead of Host and Port when not empty.
+    std::string UnixSocketPath;
+    bool UseTls = false;
+};
+
+// Stream socket with optional deadlines. Subclasses only establish the connection.
+class TSocketConnection : public TTransport {
+public:
+    ~TSocketConnection() override;
+
+    // Zero timeout means "wait forever".
+    static std::unique_ptr<TSocketConnection> Create(
+            const TEndpoint& endpoint,
+            const std::chrono::milliseconds connectTimeout = std::chrono::milliseconds::zero(),
+            const std::chrono::milliseconds operationTimeout = std::chrono::milliseconds::zero());
+
+    void Send(const std::string& data) override;
+    int ReceiveChunk(void* result, const int estimatedSize) override;
+    int PeekChunk(void* result, const int estimatedSize) override;
+
+    void Shutdown() override;
+
+    int GetDescriptor() const;
+    // Makes blocking calls made on the descriptor directly (by TLS, for example) time out as well.
+    void SetDescriptorTimeouts();
+
+    bool IsGood() const override;
+
+protected:
+    TSocketConnection(const std::chrono::milliseconds connectTimeout, const std::chrono::milliseconds operationTimeout);
+
+    // Connects SocketDecriptor within ConnectTimeout.
+    bool Connect(const struct sockaddr* address, const socklen_t addressLength);
+    void Close();
+
+protected:
+    int SocketDecriptor = -1;
+
+private:
+    void WaitForReadiness(const short events);
+
+    void CheckConnectionIsGood() const;
+
+private:
+    // Cleared by Shutdown from another thread as well.
+    std::atomic<bool> Good{true};
+
+    const std::chrono::milliseconds ConnectTimeout;
+    const std::chrono::milliseconds OperationTimeout;
+
+    // A peer which has gone away fails the send instead of killing the process with SIGPIPE.
+#ifdef MSG_NOSIGNAL
+    static const int SendFlags = MSG_NOSIGNAL;
+#else
+    static const int SendFlags = 0;
+#endif
+};
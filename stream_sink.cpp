@@ -0,0 +1,129 @@
+#include "stream_sink.h"
+#include "error.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+
+TStreamSink::TStreamSink(TWriteCallback write, const size_t maxBufferedBytes)
+    : Write(std::move(write))
+    , MaxBufferedBytes(maxBufferedBytes)
+{
+}
+
+TStreamSink::TWriteCallback TStreamSink::CreateDescriptorWriter(const int descriptor) {
+    return [descriptor](const std::string_view& data) {
+        size_t totalWritten = 0;
+        while (totalWritten < data.size()) {
+            const ssize_t written = write(descriptor, data.data() + totalWritten, data.size() - totalWritten);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                throw TError("Unable to write output", false);
+            }
+
+            totalWritten += written;
+        }
+    };
+}
+
+void TStreamSink::Allocate(const size_t size) {
+    std::unique_lock<std::mutex> lock(Mutex);
+    AllocatedSize = size;
+}
+
+void TStreamSink::WriteAt(const size_t offset, const std::string_view& data) {
+    std::unique_lock<std::mutex> lock(Mutex);
+
+    size_t position = offset;
+    std::string_view rest = data;
+    TMemoryBudget::TLease lease;
+
+    while (true) {
+        if (Cancelled) {
+            throw TError("Output is cancelled", false);
+        }
+
+        // Parts which were already emitted (by a retried request for example) are skipped.
+        if (position < NextOffset) {
+            const size_t skipSize = std::min(NextOffset - position, rest.size());
+            position += skipSize;
+            rest.remove_prefix(skipSize);
+        }
+
+        if (rest.empty()) {
+            return;
+        }
+
+        if (position == NextOffset) {
+            break;
+        }
+
+        if (BufferedBytes + rest.size() > GetMaxBufferedBytes()) {
+            Condition.wait(lock);
+        } else if (TMemoryBudget::Instance().TryAcquire(rest.size(), lease)) {
+            break;
+        } else {
+            Condition.wait_for(lock, BudgetWaitStep);
+        }
+    }
+
+    if (position != NextOffset) {
+        if (!Pending.count(position)) {
+            Pending.emplace(position, TPart{std::string(rest), std::move(lease)});
+            BufferedBytes += rest.size();
+        }
+
+        return;
+    }
+
+    Emit(rest);
+    NextOffset += rest.size();
+
+    while (!Pending.empty() && Pending.begin()->first <= NextOffset) {
+        const std::map<size_t, TPart>::iterator part = Pending.begin();
+        const std::string& partData = part->second.Data;
+
+        if (part->first + partData.size() > NextOffset) {
+            const std::string_view partRest = std::string_view(partData).substr(NextOffset - part->first);
+            Emit(partRest);
+            NextOffset += partRest.size();
+        }
+
+        BufferedBytes -= partData.size();
+        Pending.erase(part);
+    }
+
+    Condition.notify_all();
+}
+
+void TStreamSink::Cancel() {
+    std::unique_lock<std::mutex> lock(Mutex);
+    Cancelled = true;
+    Condition.notify_all();
+}
+
+void TStreamSink::Close() {
+    std::unique_lock<std::mutex> lock(Mutex);
+    if (!Pending.empty() || (AllocatedSize && NextOffset != *AllocatedSize)) {
+        throw TError("Output is incomplete", false);
+    }
+}
+
+size_t TStreamSink::GetMaxBufferedBytes() const {
+    // The rest of the budget is left to the ranges in flight, see THttpFileDownloader::ChooseRangeLayout.
+    const size_t limit = TMemoryBudget::Instance().GetLimit();
+    return limit > 0 ? std::min(MaxBufferedBytes, limit / 2) : MaxBufferedBytes;
+}
+
+void TStreamSink::Emit(const std::string_view& data) {
+    try {
+        Write(data);
+    } catch (...) {
+        Cancelled = true;
+        Condition.notify_all();
+        throw;
+    }
+}
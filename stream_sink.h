@@ -0,0 +1,60 @@
+#pragma once
+
+#include "memory_budget.h"
+#include "output_sink.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+// Emits the content strictly in order to a non-seekable destination (stdout,
+// a pipe or a callback). Parts which arrive ahead of time wait in a bounded
+// reorder buffer drawn from the memory budget; when it is full or the budget
+// is used up, writers of such parts block until the gap before them is filled,
+// which holds back whoever is fetching them.
+class TStreamSink : public TOutputSink {
+public:
+    using TWriteCallback = std::function<void(const std::string_view&)>;
+
+public:
+    TStreamSink(TWriteCallback write, const size_t maxBufferedBytes = DefaultMaxBufferedBytes);
+
+    static TWriteCallback CreateDescriptorWriter(const int descriptor);
+
+    virtual void Allocate(const size_t size) override;
+    virtual void WriteAt(const size_t offset, const std::string_view& data) override;
+    virtual void Cancel() override;
+    virtual void Close() override;
+
+    static const size_t DefaultMaxBufferedBytes = 64 * 1024 * 1024;
+    // Memory given back to the budget does not wake writers up, so they look again after this.
+    static constexpr std::chrono::milliseconds BudgetWaitStep = std::chrono::milliseconds(10);
+
+private:
+    class TPart {
+    public:
+        std::string Data;
+        TMemoryBudget::TLease Lease;
+    };
+
+private:
+    size_t GetMaxBufferedBytes() const;
+    void Emit(const std::string_view& data);
+
+private:
+    const TWriteCallback Write;
+    const size_t MaxBufferedBytes;
+
+    std::mutex Mutex;
+    std::condition_variable Condition;
+
+    std::map<size_t, TPart> Pending;
+    size_t BufferedBytes = 0;
+    size_t NextOffset = 0;
+    std::optional<size_t> AllocatedSize;
+    bool Cancelled = false;
+};
@@ -10,57 +10,16 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
-TTcpConnection::TTcpConnection(const std::string& host, const std::string& port) {
+TTcpConnection::TTcpConnection(
+        const std::string& host,
+        const std::string& port,
+        const std::chrono::milliseconds connectTimeout,
+        const std::chrono::milliseconds operationTimeout)
+    : TSocketConnection(connectTimeout, operationTimeout)
+{
     Establish(host, port);
 }
 
-TTcpConnection::~TTcpConnection() {
-    Close();
-}
-
-void TTcpConnection::Send(const std::string& data) {
-    CheckConnectionIsGood();
-
-    int totalBytesSended = 0;
-    while (totalBytesSended < data.size()) {
-        const int bytesSended = send(SocketDecriptor, data.c_str(), data.size(), 0);
-        if (bytesSended < 0) {
-            Good = false;
-            throw TError("Cannot send data", true);
-        }
-
-        totalBytesSended += bytesSended;
-    }
-}
-
-int TTcpConnection::ReceiveChunk(void* result, const int estimatedSize) {
-    CheckConnectionIsGood();
-
-    const int bytesReceived = recv(SocketDecriptor, result, estimatedSize, 0);
-    if (bytesReceived < 0) {
-        Good = false;
-        throw TError("Cannot receive data", true);
-    }
-
-    return bytesReceived;
-}
-
-int TTcpConnection::PeekChunk(void* result, const int estimatedSize) {
-    CheckConnectionIsGood();
-
-    const int bytesReceived = recv(SocketDecriptor, result, estimatedSize, MSG_PEEK);
-    if (bytesReceived < 0) {
-        Good = false;
-        throw TError("Cannot peek data", true);
-    }
-
-    return bytesReceived;
-}
-
-bool TTcpConnection::IsGood() const {
-    return Good;
-}
-
 void TTcpConnection::Establish(const std::string& host, const std::string& port) {
     struct addrinfo* result = nullptr;
     try {
@@ -91,16 +50,19 @@ void TTcpConnection::Establish(const std::string& host, const std::string& port)
                 continue;
             }
 
-            if (connect(SocketDecriptor, address->ai_addr, address->ai_addrlen) != -1) {
+            if (Connect(address->ai_addr, address->ai_addrlen)) {
                 break;
             }
 
             close(SocketDecriptor);
+            SocketDecriptor = -1;
         }
 
         if (!address) {
             throw TError("Could not connect", false);
         }
+
+        freeaddrinfo(result);
     } catch (...) {
         if (result) {
             freeaddrinfo(result);
@@ -109,15 +71,3 @@ void TTcpConnection::Establish(const std::string& host, const std::string& port)
         throw;
     }
 }
-
-void TTcpConnection::Close() {
-    close(SocketDecriptor);
-    Good = false;
-}
-
-void TTcpConnection::CheckConnectionIsGood() const {
-    if (!IsGood()) {
-        throw TError("Attempt to use bad connection", true);
-    }
-}
-
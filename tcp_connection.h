@@ -1,27 +1,19 @@
 #pragma once
 
+#include "socket_connection.h"
+
+#include <chrono>
 #include <string>
 
-class TTcpConnection {
+class TTcpConnection : public TSocketConnection {
 public:
-    TTcpConnection(const std::string& host, const std::string& port);
-    ~TTcpConnection();
-
-    void Send(const std::string& data);
-    int ReceiveChunk(void* result, const int estimatedSize);
-    int PeekChunk(void* result, const int estimatedSize);
-
-    bool IsEstablished() const;
-    bool IsGood() const;
+    // Zero timeout means "wait forever".
+    TTcpConnection(
+            const std::string& host,
+            const std::string& port,
+            const std::chrono::milliseconds connectTimeout = std::chrono::milliseconds::zero(),
+            const std::chrono::milliseconds operationTimeout = std::chrono::milliseconds::zero());
 
 private:
     void Establish(const std::string& host, const std::string& port);
-    void Close();
-
-    void CheckConnectionIsGood() const;
-
-private:
-    int SocketDecriptor;
-    bool Good = true;
 };
-
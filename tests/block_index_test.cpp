@@ -0,0 +1,186 @@
+// Builds TBlockIndex of a file and looks for its blocks in other versions of
+// the data with TBlockIndex::FindBlocks: with bytes inserted or deleted in the
+// middle (so the blocks after it are shifted) and with the last block padded.
+// Fails on a mismatch:
+//
+//     make test
+#include "../block_index.h"
+#include "../error.h"
+
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+class TTestCase {
+public:
+    std::string Name;
+    std::function<void()> Run;
+};
+
+static const size_t BlockSize = 64;
+
+std::string MakeRandomData(const size_t size, const uint64_t seed) {
+    std::mt19937_64 random(seed);
+
+    std::string data(size, '\0');
+    for (char& symbol : data) {
+        symbol = static_cast<char>(random() % 256);
+    }
+
+    return data;
+}
+
+void Check(const bool condition, const std::string& message) {
+    if (!condition) {
+        throw TError(message, false);
+    }
+}
+
+TBlockIndex BuildIndex(const std::string& content) {
+    char path[] = "/tmp/lruc-block-index-XXXXXX";
+    const int descriptor = mkstemp(path);
+    Check(descriptor != -1, "cannot create a temporary file");
+
+    const bool isWritten = write(descriptor, content.data(), content.size()) == static_cast<ssize_t>(content.size());
+    close(descriptor);
+
+    try {
+        Check(isWritten, "cannot write a temporary file");
+        const TBlockIndex index = TBlockIndex::Build(path, BlockSize);
+        unlink(path);
+        return index;
+    } catch (...) {
+        unlink(path);
+        throw;
+    }
+}
+
+// expected[i] is where block i of the index should be found in data, if anywhere.
+void CheckFound(const TBlockIndex& index, const std::string& data, const std::vector<std::optional<size_t>>& expected) {
+    const std::vector<std::optional<size_t>> found = index.FindBlocks(data.data(), data.size());
+    Check(found.size() == expected.size(), "wrong number of blocks");
+
+    for (size_t block = 0; block < found.size(); ++block) {
+        const std::string name = "block " + std::to_string(block);
+        Check(found[block].has_value() == expected[block].has_value(), name + (expected[block] ? " is not found" : " is found where it is not"));
+        if (!found[block]) {
+            continue;
+        }
+
+        Check(*found[block] == *expected[block], name + " is found at " + std::to_string(*found[block]) + " instead of " + std::to_string(*expected[block]));
+        Check(index.CheckBlock(block, data.data() + *found[block]), name + " does not match its hash where it is found");
+    }
+}
+
+void TestSameData() {
+    const std::string content = MakeRandomData(1000, 1);
+    const TBlockIndex index = BuildIndex(content);
+
+    Check(index.Size == content.size() && index.Blocks.size() == 16, "wrong index size");
+    Check(index.GetBlockDataSize(15) == 1000 - 15 * BlockSize, "wrong size of the last block");
+
+    std::vector<std::optional<size_t>> expected;
+    for (size_t block = 0; block < index.Blocks.size(); ++block) {
+        expected.push_back(index.GetBlockOffset(block));
+    }
+
+    CheckFound(index, content, expected);
+}
+
+void TestInsertedData() {
+    // The new file has 17 bytes inserted at 300, the old copy is searched for its blocks.
+    const std::string oldData = MakeRandomData(1000, 2);
+    const std::string content = oldData.substr(0, 300) + MakeRandomData(17, 3) + oldData.substr(300);
+    const TBlockIndex index = BuildIndex(content);
+
+    std::vector<std::optional<size_t>> expected(index.Blocks.size());
+    for (size_t block = 0; block < index.Blocks.size(); ++block) {
+        const size_t offset = index.GetBlockOffset(block);
+        if (offset + BlockSize <= 300) {
+            expected[block] = offset;
+        } else if (offset >= 300 + 17) {
+            // The padded last block matches the end of the old data, which reads as zeros beyond it.
+            expected[block] = offset - 17;
+        }
+    }
+
+    CheckFound(index, oldData, expected);
+}
+
+void TestDeletedData() {
+    // The new file misses 23 bytes at 300.
+    const std::string oldData = MakeRandomData(1000, 4);
+    const std::string content = oldData.substr(0, 300) + oldData.substr(300 + 23);
+    const TBlockIndex index = BuildIndex(content);
+
+    std::vector<std::optional<size_t>> expected(index.Blocks.size());
+    for (size_t block = 0; block < index.Blocks.size(); ++block) {
+        const size_t offset = index.GetBlockOffset(block);
+        if (offset + BlockSize <= 300) {
+            expected[block] = offset;
+        } else if (offset >= 300) {
+            expected[block] = offset + 23;
+        }
+    }
+
+    CheckFound(index, oldData, expected);
+}
+
+void TestPaddedLastBlock() {
+    // The old copy goes on after the end of the new file, so the padded
+    // last block is not there: its zeros do not match the bytes that follow.
+    const std::string content = MakeRandomData(1000, 5);
+    const std::string oldData = content + MakeRandomData(100, 6);
+    const TBlockIndex index = BuildIndex(content);
+
+    std::vector<std::optional<size_t>> expected(index.Blocks.size());
+    for (size_t block = 0; block + 1 < index.Blocks.size(); ++block) {
+        expected[block] = index.GetBlockOffset(block);
+    }
+
+    CheckFound(index, oldData, expected);
+
+    // Followed by zeros it is found in the middle of the data.
+    const size_t lastBlockOffset = index.GetBlockOffset(index.Blocks.size() - 1);
+    const std::string zeroPadded = content + std::string(BlockSize, '\0') + MakeRandomData(100, 7);
+    expected.back() = lastBlockOffset;
+
+    CheckFound(index, zeroPadded, expected);
+}
+
+void TestSerialization() {
+    const std::string content = MakeRandomData(1000, 8);
+    const TBlockIndex index = BuildIndex(content);
+    const TBlockIndex parsed = TBlockIndex::Parse(index.Serialize());
+
+    Check(parsed.Size == index.Size && parsed.BlockSize == index.BlockSize && parsed.Blocks.size() == index.Blocks.size(), "wrong layout after parsing");
+    for (size_t block = 0; block < index.Blocks.size(); ++block) {
+        Check(parsed.Blocks[block].Checksum == index.Blocks[block].Checksum && parsed.Blocks[block].Hash == index.Blocks[block].Hash, "wrong block after parsing");
+    }
+}
+
+int main() {
+    const TTestCase cases[] = {
+        {"same data", TestSameData},
+        {"inserted data", TestInsertedData},
+        {"deleted data", TestDeletedData},
+        {"padded last block", TestPaddedLastBlock},
+        {"serialization", TestSerialization},
+    };
+
+    for (const TTestCase& testCase : cases) {
+        try {
+            testCase.Run();
+        } catch (const std::exception& error) {
+            std::cerr << "FAILED: " << testCase.Name << ": " << error.what() << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,127 @@
+// Drives THttpConnection (head parsing and body reading) over TMemoryTransport,
+// so the numbers are user-space cost only. Every response is checked as well,
+// and the process fails on a mismatch:
+//
+//     make bench
+#include "../error.h"
+#include "../http_connection.h"
+#include "../memory_transport.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+class TBenchCase {
+public:
+    std::string Name;
+    size_t HeaderCount = 0;
+    size_t BodySize = 0;
+    TReadFragmentation Fragmentation;
+    // The body is handed over in parts instead of being kept whole.
+    bool IsPartial = false;
+    size_t RequestCount = 0;
+};
+
+std::string MakeBody(const size_t size) {
+    std::string body(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+        body[i] = static_cast<char>('a' + i % 26);
+    }
+
+    return body;
+}
+
+std::string MakeHead(const size_t headerCount, const size_t bodySize) {
+    std::string head = "HTTP/1.1 200 OK\r\n";
+    for (size_t i = 0; i < headerCount; ++i) {
+        head += "X-Header-" + std::to_string(i) + ": value-" + std::to_string(i) + "\r\n";
+    }
+
+    head += "Content-Length: " + std::to_string(bodySize) + "\r\n\r\n";
+    return head;
+}
+
+void Check(const bool condition, const std::string& message) {
+    if (!condition) {
+        throw TError(message, false);
+    }
+}
+
+void RunCase(const TBenchCase& benchCase) {
+    const std::string body = MakeBody(benchCase.BodySize);
+    const std::string response = MakeHead(benchCase.HeaderCount, benchCase.BodySize) + body;
+
+    THttpConnection connection(
+            std::make_unique<TMemoryTransport>(
+                    [&response](const std::string&) {
+                        return response;
+                    },
+                    benchCase.Fragmentation));
+
+    const std::string request = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < benchCase.RequestCount; ++i) {
+        size_t received = 0;
+        bool isBodyIntact = true;
+
+        std::optional<THttpConnection::TBufferFilledCallback> callback;
+        if (benchCase.IsPartial) {
+            callback = [&](const THttpResponse& result, const size_t bufferSize) {
+                isBodyIntact = isBodyIntact && body.compare(received, bufferSize, result.BodyRawData.data(), bufferSize) == 0;
+                received += bufferSize;
+            };
+        }
+
+        const THttpResponse result = connection.PerformRequest(request, true, callback);
+        if (!benchCase.IsPartial) {
+            isBodyIntact = result.BodyRawData == body;
+            received = result.BodyRawData.size();
+        }
+
+        Check(result.StatusCode == 200, "wrong status");
+        Check(result.Headers.size() == benchCase.HeaderCount + 1, "wrong header count");
+        Check(result.GetContentLength() == benchCase.BodySize, "wrong Content-Length");
+        Check(received == benchCase.BodySize && isBodyIntact, "body is corrupted");
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    const double bytes = static_cast<double>(response.size()) * benchCase.RequestCount;
+
+    std::cout << std::left << std::setw(40) << benchCase.Name
+              << std::right << std::setw(12) << std::fixed << std::setprecision(0) << elapsed.count() * 1e9 / benchCase.RequestCount << " ns/response"
+              << std::setw(12) << std::setprecision(1) << bytes / elapsed.count() / (1024 * 1024) << " MB/s" << std::endl;
+}
+
+int main() {
+    const size_t smallHeadSize = MakeHead(0, 1000).size();
+
+    TBenchCase cases[] = {
+        {"small response, whole reads", 0, 1000, {}, false, 200000},
+        {"small response, 1-byte reads", 0, 1000, {1, false, 1}, false, 2000},
+        // Reads two bytes shorter than the head split its "\r\n\r\n" in the middle.
+        {"small response, separator split", 0, 1000, {smallHeadSize - 2, false, 1}, false, 100000},
+        {"small response, random reads", 0, 1000, {64, true, 1}, false, 50000},
+        {"50 headers, whole reads", 50, 1000, {}, false, 50000},
+        // Bigger than the initial head buffer, so it grows while reading.
+        {"1000 headers, whole reads", 1000, 1000, {}, false, 2000},
+        {"1000 headers, random reads", 1000, 1000, {4096, true, 2}, false, 2000},
+        {"1MB body, whole reads", 0, 1024 * 1024, {}, false, 500},
+        {"1MB body, 16KB reads", 0, 1024 * 1024, {16 * 1024, false, 1}, false, 500},
+        {"16MB body in parts, 64KB reads", 0, 16 * 1024 * 1024, {64 * 1024, false, 1}, true, 20},
+        {"16MB body in parts, random reads", 0, 16 * 1024 * 1024, {64 * 1024, true, 3}, true, 20},
+    };
+
+    for (const TBenchCase& benchCase : cases) {
+        try {
+            RunCase(benchCase);
+        } catch (const std::exception& error) {
+            std::cerr << "FAILED: " << benchCase.Name << ": " << error.what() << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
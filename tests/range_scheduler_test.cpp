@@ -0,0 +1,134 @@
+// Hands out the ranges of TRangeScheduler to connections over TMemoryTransport
+// and checks hedging: a range which takes much longer than the finished ones
+// is given to an idle connection once more, the copy which completes first
+// wins and aborts the others, and a range is never hedged twice.
+// Takes a little over a second (the minimum hedge delay). Fails on a mismatch:
+//
+//     make test
+#include "../error.h"
+#include "../http_connection.h"
+#include "../memory_transport.h"
+#include "../range_scheduler.h"
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+
+class TTestCase {
+public:
+    std::string Name;
+    std::function<void()> Run;
+};
+
+void Check(const bool condition, const std::string& message) {
+    if (!condition) {
+        throw TError(message, false);
+    }
+}
+
+std::unique_ptr<THttpConnection> MakeConnection() {
+    return std::make_unique<THttpConnection>(
+            std::make_unique<TMemoryTransport>(
+                    [](const std::string&) {
+                        return std::string("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+                    }));
+}
+
+void TestLayout() {
+    TRangeScheduler scheduler(50, 300, 100);
+
+    const std::shared_ptr<TRangeScheduler::TRange> first = scheduler.Next();
+    const std::shared_ptr<TRangeScheduler::TRange> second = scheduler.Next();
+    const std::shared_ptr<TRangeScheduler::TRange> third = scheduler.Next();
+
+    Check(first && first->FirstByte == 50 && first->LastByte == 149, "wrong first range");
+    Check(second && second->FirstByte == 150 && second->LastByte == 249, "wrong second range");
+    Check(third && third->FirstByte == 250 && third->LastByte == 299, "wrong last range");
+
+    for (const std::shared_ptr<TRangeScheduler::TRange>& range : {first, second, third}) {
+        Check(scheduler.Complete(*range, std::chrono::milliseconds(10)), "a range is not completed");
+    }
+
+    Check(!scheduler.Next(), "a range is handed out after everything is fetched");
+}
+
+void TestHedging() {
+    TRangeScheduler scheduler(0, 300, 100);
+
+    const std::shared_ptr<TRangeScheduler::TRange> first = scheduler.Next();
+    const std::shared_ptr<TRangeScheduler::TRange> second = scheduler.Next();
+    const std::shared_ptr<TRangeScheduler::TRange> slow = scheduler.Next();
+
+    const std::unique_ptr<THttpConnection> slowConnection = MakeConnection();
+    Check(scheduler.Attach(*slow, *slowConnection), "cannot attach to a range in progress");
+
+    Check(scheduler.Complete(*first, std::chrono::milliseconds(10)), "the first range is not completed");
+    Check(scheduler.Complete(*second, std::chrono::milliseconds(10)), "the second range is not completed");
+
+    // An idle connection waits until the slow range is late and gets a copy of it.
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const std::shared_ptr<TRangeScheduler::TRange> hedged = scheduler.Next();
+    const std::chrono::steady_clock::duration waited = std::chrono::steady_clock::now() - start;
+
+    Check(hedged == slow, "the late range is not hedged");
+    Check(waited >= std::chrono::seconds(1), "a range is hedged before the minimum delay");
+
+    const std::unique_ptr<THttpConnection> hedgeConnection = MakeConnection();
+    Check(scheduler.Attach(*hedged, *hedgeConnection), "cannot attach to a hedged range");
+
+    // One more idle connection gets no second copy; it waits until the range is done.
+    std::future<std::shared_ptr<TRangeScheduler::TRange>> idle = std::async(std::launch::async, [&scheduler]() {
+        return scheduler.Next();
+    });
+    Check(idle.wait_for(std::chrono::milliseconds(300)) == std::future_status::timeout, "a range is hedged twice");
+
+    // The winner is done with its request and detaches before completing, as THttpFileDownloader does.
+    scheduler.Detach(*hedged, *hedgeConnection);
+    Check(scheduler.Complete(*hedged, std::chrono::milliseconds(10)), "the hedged copy is not completed");
+    Check(!slowConnection->IsGood(), "the outrun connection is not aborted");
+    Check(hedgeConnection->IsGood(), "the winning connection is aborted");
+
+    scheduler.Detach(*slow, *slowConnection);
+    Check(!scheduler.Complete(*slow, std::chrono::seconds(2)), "the outrun copy is completed as well");
+    Check(scheduler.IsDone(*slow), "the hedged range is not done");
+    Check(!scheduler.Attach(*slow, *slowConnection), "a connection is attached to a finished range");
+
+    Check(idle.wait_for(std::chrono::seconds(1)) == std::future_status::ready && !idle.get(), "the idle connection is not released");
+}
+
+void TestCancel() {
+    TRangeScheduler scheduler(0, 100, 100);
+
+    const std::shared_ptr<TRangeScheduler::TRange> range = scheduler.Next();
+    Check(range != nullptr, "no range is handed out");
+
+    std::future<std::shared_ptr<TRangeScheduler::TRange>> idle = std::async(std::launch::async, [&scheduler]() {
+        return scheduler.Next();
+    });
+
+    scheduler.Cancel();
+    Check(idle.wait_for(std::chrono::seconds(1)) == std::future_status::ready && !idle.get(), "a waiting connection is not released by Cancel");
+}
+
+int main() {
+    const TTestCase cases[] = {
+        {"layout", TestLayout},
+        {"hedging", TestHedging},
+        {"cancel", TestCancel},
+    };
+
+    for (const TTestCase& testCase : cases) {
+        try {
+            testCase.Run();
+        } catch (const std::exception& error) {
+            std::cerr << "FAILED: " << testCase.Name << ": " << error.what() << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,223 @@
+// Downloads with THttpFileDownloader from an in-memory server (TMemoryTransport
+// through TransportFactory) which breaks a response in the middle of the body,
+// and checks that the retry resumes from the last written byte with If-Range,
+// that without ranges the content is fetched again and the written part is
+// skipped, and that a resource changed in between is never mixed.
+// Fails on a mismatch:
+//
+//     make test
+#include "../error.h"
+#include "../http_file_downloader.h"
+#include "../memory_transport.h"
+#include "../stream_sink.h"
+
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+class TTestCase {
+public:
+    std::string Name;
+    std::function<void()> Run;
+};
+
+// Answers GET with or without "Range: bytes=<first>-[<last>]" the way an HTTP server would.
+class TTestServer {
+public:
+    std::string Content;
+    std::string ETag = "\"v1\"";
+    bool HasByteRange = true;
+
+    // The body of the response to this request (counting from zero) is cut after BreakAfterBytes.
+    std::optional<size_t> BreakRequest;
+    size_t BreakAfterBytes = 0;
+    // Replaces the content and its ETag once the body is cut.
+    std::optional<std::string> ContentAfterBreak;
+
+    // Range and If-Range of every request, empty when absent.
+    std::vector<std::string> Ranges;
+    std::vector<std::string> Validators;
+
+public:
+    std::string Respond(const std::string& request);
+
+private:
+    static std::string GetHeaderValue(const std::string& request, const std::string& name);
+};
+
+std::string TTestServer::Respond(const std::string& request) {
+    const std::string range = GetHeaderValue(request, "Range");
+    const std::string validator = GetHeaderValue(request, "If-Range");
+    Ranges.push_back(range);
+    Validators.push_back(validator);
+
+    std::string head;
+    std::string body;
+    if (HasByteRange && !range.empty() && (validator.empty() || validator == ETag)) {
+        // bytes=<first>-[<last>]
+        const size_t dash = range.find('-');
+        const size_t first = std::stoul(range.substr(6, dash - 6));
+        const size_t last = dash + 1 < range.size() ? std::min<size_t>(std::stoul(range.substr(dash + 1)), Content.size() - 1) : Content.size() - 1;
+
+        body = Content.substr(first, last - first + 1);
+        head = "HTTP/1.1 206 Partial Content\r\n";
+        head += "Content-Range: bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" + std::to_string(Content.size()) + "\r\n";
+    } else {
+        body = Content;
+        head = "HTTP/1.1 200 OK\r\n";
+    }
+
+    head += "ETag: " + ETag + "\r\n";
+    head += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+
+    if (BreakRequest && *BreakRequest == Ranges.size() - 1) {
+        body.resize(BreakAfterBytes);
+
+        if (ContentAfterBreak) {
+            Content = *ContentAfterBreak;
+            ETag = "\"v2\"";
+        }
+    }
+
+    return head + body;
+}
+
+std::string TTestServer::GetHeaderValue(const std::string& request, const std::string& name) {
+    const size_t start = request.find("\r\n" + name + ": ");
+    if (start == std::string::npos) {
+        return std::string();
+    }
+
+    const size_t valueStart = start + name.size() + 4;
+    return request.substr(valueStart, request.find("\r\n", valueStart) - valueStart);
+}
+
+std::string MakeContent(const size_t size, const char first) {
+    std::string content(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+        content[i] = static_cast<char>(first + i % 26);
+    }
+
+    return content;
+}
+
+void Check(const bool condition, const std::string& message) {
+    if (!condition) {
+        throw TError(message, false);
+    }
+}
+
+// Every connection of the downloader talks to the same server.
+std::string Download(TTestServer& server) {
+    TDownloadOptions options;
+    {
+        options.Retry.InitialBackoff = std::chrono::milliseconds(1);
+        options.Retry.MaxBackoff = std::chrono::milliseconds(1);
+        options.TransportFactory = [&server](const TEndpoint&) {
+            return std::make_unique<TMemoryTransport>(
+                    [&server](const std::string& request) {
+                        return server.Respond(request);
+                    },
+                    TReadFragmentation{64 * 1024, false, 1});
+        };
+    }
+
+    std::string output;
+    TStreamSink sink([&output](const std::string_view& data) {
+        output.append(data);
+    });
+
+    THttpFileDownloader downloader("http://localhost/file", options);
+    downloader.Download(sink);
+    sink.Close();
+
+    return output;
+}
+
+static const size_t ContentSize = 3 * 1024 * 1024;
+static const size_t ProbeSize = 1024 * 1024;
+
+void TestResumeFromLastByte() {
+    TTestServer server;
+    server.Content = MakeContent(ContentSize, 'a');
+    server.BreakRequest = 1;
+    server.BreakAfterBytes = 500 * 1024;
+
+    Check(Download(server) == server.Content, "output differs from the content");
+
+    const std::vector<std::string> expectedRanges = {
+        "bytes=0-" + std::to_string(ProbeSize - 1),
+        "bytes=" + std::to_string(ProbeSize) + "-",
+        "bytes=" + std::to_string(ProbeSize + 500 * 1024) + "-",
+    };
+    Check(server.Ranges == expectedRanges, "the retry does not continue from the last written byte");
+    Check(server.Validators[1] == server.ETag && server.Validators[2] == server.ETag, "the rest is requested without If-Range");
+}
+
+void TestResumeBrokenProbe() {
+    TTestServer server;
+    server.Content = MakeContent(ContentSize, 'a');
+    server.BreakRequest = 0;
+    server.BreakAfterBytes = 300 * 1024;
+
+    Check(Download(server) == server.Content, "output differs from the content");
+
+    const std::vector<std::string> expectedRanges = {
+        "bytes=0-" + std::to_string(ProbeSize - 1),
+        "bytes=" + std::to_string(300 * 1024) + "-",
+    };
+    Check(server.Ranges == expectedRanges, "the probe is repeated instead of continuing from its last byte");
+}
+
+void TestRestartWithoutRanges() {
+    TTestServer server;
+    server.Content = MakeContent(ContentSize, 'a');
+    server.HasByteRange = false;
+    server.BreakRequest = 0;
+    server.BreakAfterBytes = 1500 * 1024;
+
+    Check(Download(server) == server.Content, "the written part is not skipped when the content is fetched again");
+    Check(server.Ranges.size() == 2 && server.Ranges[1].empty(), "a range is asked from a server without byte serving");
+}
+
+void TestChangedResource() {
+    TTestServer server;
+    server.Content = MakeContent(ContentSize, 'a');
+    server.BreakRequest = 1;
+    server.BreakAfterBytes = 500 * 1024;
+    server.ContentAfterBreak = MakeContent(ContentSize, 'A');
+
+    bool isRefused = false;
+    try {
+        Download(server);
+    } catch (const TError&) {
+        isRefused = true;
+    }
+
+    Check(isRefused, "parts of different versions of the resource are mixed");
+    Check(server.Ranges.size() == 3, "a changed resource is retried");
+}
+
+int main() {
+    const TTestCase cases[] = {
+        {"resume from the last byte", TestResumeFromLastByte},
+        {"resume a broken probe", TestResumeBrokenProbe},
+        {"restart without ranges", TestRestartWithoutRanges},
+        {"changed resource", TestChangedResource},
+    };
+
+    for (const TTestCase& testCase : cases) {
+        try {
+            testCase.Run();
+        } catch (const std::exception& error) {
+            std::cerr << "FAILED: " << testCase.Name << ": " << error.what() << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "OK" << std::endl;
+    return 0;
+}
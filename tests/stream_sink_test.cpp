@@ -0,0 +1,215 @@
+// Writes parts to TStreamSink out of order, twice and overlapping, the way
+// parallel and retried ranges do, and checks that the output is the content
+// in order, that a writer ahead of a full reorder buffer waits for the gap
+// and that an incomplete stream is refused. Fails on a mismatch:
+//
+//     make test
+#include "../error.h"
+#include "../stream_sink.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+
+class TTestCase {
+public:
+    std::string Name;
+    std::function<void()> Run;
+};
+
+std::string MakeContent(const size_t size) {
+    std::string content(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+        content[i] = static_cast<char>('a' + i % 26);
+    }
+
+    return content;
+}
+
+void Check(const bool condition, const std::string& message) {
+    if (!condition) {
+        throw TError(message, false);
+    }
+}
+
+// Collects whatever the sink emits.
+TStreamSink::TWriteCallback MakeCollector(std::string& output) {
+    return [&output](const std::string_view& data) {
+        output.append(data);
+    };
+}
+
+void WritePart(TStreamSink& sink, const std::string& content, const size_t first, const size_t size) {
+    sink.WriteAt(first, std::string_view(content).substr(first, size));
+}
+
+void TestInOrder() {
+    const std::string content = MakeContent(100);
+
+    std::string output;
+    TStreamSink sink(MakeCollector(output));
+    sink.Allocate(content.size());
+
+    for (size_t offset = 0; offset < content.size(); offset += 10) {
+        WritePart(sink, content, offset, 10);
+    }
+
+    sink.Close();
+    Check(output == content, "output differs from the content");
+}
+
+void TestReorder() {
+    const std::string content = MakeContent(100);
+
+    std::string output;
+    TStreamSink sink(MakeCollector(output));
+    sink.Allocate(content.size());
+
+    WritePart(sink, content, 70, 30);
+    WritePart(sink, content, 30, 20);
+    WritePart(sink, content, 50, 20);
+    Check(output.empty(), "a part is emitted before the gap in front of it is filled");
+
+    WritePart(sink, content, 0, 30);
+    Check(output == content, "buffered parts are not emitted in order once the gap is filled");
+
+    sink.Close();
+}
+
+void TestSkip() {
+    const std::string content = MakeContent(100);
+
+    std::string output;
+    TStreamSink sink(MakeCollector(output));
+    sink.Allocate(content.size());
+
+    WritePart(sink, content, 0, 40);
+    // A retried request which starts over from the beginning.
+    WritePart(sink, content, 0, 20);
+    Check(output == content.substr(0, 40), "an emitted part is emitted again");
+
+    // Overlaps what is emitted, only the tail is new.
+    WritePart(sink, content, 30, 30);
+    Check(output == content.substr(0, 60), "the new tail of an overlapping part is lost");
+
+    // A buffered part which the next write covers in part.
+    WritePart(sink, content, 80, 20);
+    WritePart(sink, content, 60, 30);
+    Check(output == content, "a buffered part overlapping the emitted bytes is emitted wrong");
+
+    sink.Close();
+}
+
+void TestFullBufferBlocks() {
+    const std::string content = MakeContent(100);
+
+    std::string output;
+    TStreamSink sink(MakeCollector(output), 30);
+    sink.Allocate(content.size());
+
+    WritePart(sink, content, 20, 20);
+
+    // Does not fit next to the part already buffered.
+    std::atomic<bool> isWritten(false);
+    std::thread writer([&]() {
+        WritePart(sink, content, 40, 20);
+        isWritten = true;
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    const bool isWrittenEarly = isWritten;
+
+    WritePart(sink, content, 0, 20);
+    writer.join();
+
+    Check(!isWrittenEarly, "a part beyond the buffer limit is buffered instead of waiting");
+    Check(output == content.substr(0, 60), "the waiting part is not emitted after the gap is filled");
+
+    WritePart(sink, content, 60, 40);
+    sink.Close();
+    Check(output == content, "output differs from the content");
+}
+
+void TestCancelWakesWriter() {
+    const std::string content = MakeContent(100);
+
+    std::string output;
+    TStreamSink sink(MakeCollector(output), 10);
+
+    std::atomic<bool> isFailed(false);
+    std::thread writer([&]() {
+        try {
+            WritePart(sink, content, 50, 20);
+        } catch (const TError&) {
+            isFailed = true;
+        }
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    sink.Cancel();
+    writer.join();
+
+    Check(isFailed, "a waiting writer is not failed by Cancel");
+}
+
+void TestIncomplete() {
+    const std::string content = MakeContent(100);
+
+    {
+        std::string output;
+        TStreamSink sink(MakeCollector(output));
+        sink.Allocate(content.size());
+        WritePart(sink, content, 0, 90);
+
+        bool isRefused = false;
+        try {
+            sink.Close();
+        } catch (const TError&) {
+            isRefused = true;
+        }
+
+        Check(isRefused, "a stream shorter than the allocated size is closed");
+    }
+
+    {
+        std::string output;
+        TStreamSink sink(MakeCollector(output));
+        WritePart(sink, content, 0, 40);
+        WritePart(sink, content, 60, 40);
+
+        bool isRefused = false;
+        try {
+            sink.Close();
+        } catch (const TError&) {
+            isRefused = true;
+        }
+
+        Check(isRefused, "a stream with a gap is closed");
+    }
+}
+
+int main() {
+    const TTestCase cases[] = {
+        {"in order", TestInOrder},
+        {"reorder", TestReorder},
+        {"skip emitted bytes", TestSkip},
+        {"full buffer blocks", TestFullBufferBlocks},
+        {"cancel wakes writer", TestCancelWakesWriter},
+        {"incomplete stream", TestIncomplete},
+    };
+
+    for (const TTestCase& testCase : cases) {
+        try {
+            testCase.Run();
+        } catch (const std::exception& error) {
+            std::cerr << "FAILED: " << testCase.Name << ": " << error.what() << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "OK" << std::endl;
+    return 0;
+}
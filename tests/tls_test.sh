@@ -0,0 +1,70 @@
+#!/bin/sh
+# Downloads over HTTPS from a local server with a self-signed certificate
+# (trusted with --cacert) and checks that the content is intact, that the
+# parallel connections resume the TLS session of the first one, and that an
+# untrusted certificate is refused. Needs openssl and python3:
+#
+#     make test
+set -e
+
+LRUC="${LRUC:-./lruc}"
+PORT="${TLS_TEST_PORT:-18443}"
+TESTS_DIRECTORY="$(cd "$(dirname "$0")" && pwd)"
+WORK_DIRECTORY="$(mktemp -d)"
+SERVER_PID=
+
+cleanup() {
+    if [ -n "$SERVER_PID" ]; then
+        kill "$SERVER_PID" 2>/dev/null || true
+    fi
+
+    rm -rf "$WORK_DIRECTORY"
+}
+trap cleanup EXIT
+
+fail() {
+    echo "FAILED: $1" >&2
+    exit 1
+}
+
+openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj "/CN=localhost" \
+    -addext "subjectAltName=DNS:localhost,IP:127.0.0.1" \
+    -keyout "$WORK_DIRECTORY/key.pem" -out "$WORK_DIRECTORY/cert.pem" 2>/dev/null
+
+# Big enough to be fetched by ranges over parallel connections.
+mkdir "$WORK_DIRECTORY/www"
+head -c 40000000 /dev/urandom > "$WORK_DIRECTORY/www/big.bin"
+head -c 3000 /dev/urandom > "$WORK_DIRECTORY/www/small.bin"
+
+python3 "$TESTS_DIRECTORY/tls_server.py" "$PORT" "$WORK_DIRECTORY/www" "$WORK_DIRECTORY/cert.pem" "$WORK_DIRECTORY/key.pem" &
+SERVER_PID=$!
+
+for attempt in $(seq 1 50); do
+    if openssl s_client -connect "127.0.0.1:$PORT" < /dev/null > /dev/null 2>&1; then
+        break
+    fi
+
+    sleep 0.1
+done
+
+# A certificate nobody vouches for is refused.
+if "$LRUC" "https://localhost:$PORT/small.bin" "$WORK_DIRECTORY/small.out" > /dev/null 2>&1; then
+    fail "untrusted certificate was accepted"
+fi
+
+"$LRUC" --cacert "$WORK_DIRECTORY/cert.pem" "https://localhost:$PORT/small.bin" "$WORK_DIRECTORY/small.out" > /dev/null
+cmp "$WORK_DIRECTORY/small.out" "$WORK_DIRECTORY/www/small.bin" || fail "small.bin differs"
+
+"$LRUC" --cacert "$WORK_DIRECTORY/cert.pem" --connections 4 --tls-stats \
+    "https://localhost:$PORT/big.bin" "$WORK_DIRECTORY/big.out" > /dev/null 2> "$WORK_DIRECTORY/stats"
+cmp "$WORK_DIRECTORY/big.out" "$WORK_DIRECTORY/www/big.bin" || fail "big.bin differs"
+
+cat "$WORK_DIRECTORY/stats"
+HANDSHAKES=$(sed -n 's/^TLS handshakes: \([0-9]*\),.*/\1/p' "$WORK_DIRECTORY/stats")
+RESUMED=$(sed -n 's/.*resumed: \([0-9]*\),.*/\1/p' "$WORK_DIRECTORY/stats")
+
+# The first connection does the full handshake, the other three resume its session.
+[ "$HANDSHAKES" -ge 4 ] || fail "expected at least 4 handshakes, got $HANDSHAKES"
+[ "$RESUMED" -ge 3 ] || fail "expected at least 3 resumed handshakes, got $RESUMED"
+
+echo "OK"
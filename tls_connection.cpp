@@ -0,0 +1,280 @@
+#include "tls_connection.h"
+#include "error.h"
+
+#include <arpa/inet.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+
+TTlsContext::TTlsContext(const TTlsOptions& options) {
+    Context = SSL_CTX_new(TLS_client_method());
+    if (!Context) {
+        throw TError("Cannot create TLS context", false);
+    }
+
+    SSL_CTX_set_app_data(Context, this);
+    SSL_CTX_set_min_proto_version(Context, TLS1_2_VERSION);
+
+    // The body length is known from Content-Length, so a missing close_notify is not an attack.
+    // Both options are OpenSSL 3 only, older versions work without them.
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    SSL_CTX_set_options(Context, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+#ifdef SSL_OP_ENABLE_KTLS
+    SSL_CTX_set_options(Context, SSL_OP_ENABLE_KTLS);
+#endif
+
+    if (options.VerifyPeer) {
+        SSL_CTX_set_verify(Context, SSL_VERIFY_PEER, nullptr);
+        SSL_CTX_set_default_verify_paths(Context);
+
+        if (!options.CaFile.empty() && SSL_CTX_load_verify_locations(Context, options.CaFile.c_str(), nullptr) != 1) {
+            SSL_CTX_free(Context);
+            throw TError("Cannot load certificates from " + options.CaFile, false);
+        }
+    } else {
+        SSL_CTX_set_verify(Context, SSL_VERIFY_NONE, nullptr);
+    }
+
+    // Sessions are kept by the context itself, keyed by server rather than by session id.
+    SSL_CTX_set_session_cache_mode(Context, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(Context, &TTlsContext::OnNewSession);
+}
+
+TTlsContext::~TTlsContext() {
+    for (const auto& [key, session] : Sessions) {
+        SSL_SESSION_free(session);
+    }
+
+    SSL_CTX_free(Context);
+}
+
+std::shared_ptr<TTlsContext> TTlsContext::GetDefault() {
+    static const std::shared_ptr<TTlsContext> context = std::make_shared<TTlsContext>();
+    return context;
+}
+
+size_t TTlsContext::GetHandshakeCount() const {
+    return HandshakeCount;
+}
+
+size_t TTlsContext::GetResumedHandshakeCount() const {
+    return ResumedHandshakeCount;
+}
+
+size_t TTlsContext::GetKernelTlsCount() const {
+    return KernelTlsCount;
+}
+
+SSL_SESSION* TTlsContext::GetSession(const std::string& key) {
+    std::unique_lock<std::mutex> lock(Mutex);
+
+    const std::unordered_map<std::string, SSL_SESSION*>::const_iterator session = Sessions.find(key);
+    if (session == Sessions.end()) {
+        return nullptr;
+    }
+
+    SSL_SESSION_up_ref(session->second);
+    return session->second;
+}
+
+void TTlsContext::StoreSession(const std::string& key, SSL_SESSION* session) {
+    std::unique_lock<std::mutex> lock(Mutex);
+
+    SSL_SESSION*& stored = Sessions[key];
+    if (stored) {
+        SSL_SESSION_free(stored);
+    }
+
+    stored = session;
+}
+
+int TTlsContext::OnNewSession(SSL* ssl, SSL_SESSION* session) {
+    // With TLS 1.3 sessions arrive after the handshake, in the middle of reading a response.
+    const TTlsConnection* connection = static_cast<const TTlsConnection*>(SSL_get_app_data(ssl));
+    connection->Context->StoreSession(connection->SessionKey, session);
+
+    // The reference is kept.
+    return 1;
+}
+
+TTlsConnection::TTlsConnection(
+        std::unique_ptr<TSocketConnection> socket,
+        const std::string& serverName,
+        const std::string& sessionKey,
+        std::shared_ptr<TTlsContext> context)
+    : Socket(std::move(socket))
+    , Context(std::move(context))
+    , SessionKey(sessionKey)
+{
+    // OpenSSL works with the descriptor directly, bypassing the socket deadlines.
+    Socket->SetDescriptorTimeouts();
+
+    Ssl = SSL_new(Context->Context);
+    if (!Ssl) {
+        throw TError("Cannot create TLS connection", false);
+    }
+
+    SSL_set_app_data(Ssl, this);
+
+    try {
+        Handshake(serverName);
+    } catch (...) {
+        SSL_free(Ssl);
+        throw;
+    }
+}
+
+TTlsConnection::~TTlsConnection() {
+    // OpenSSL does not resume the session of a connection closed without shutdown, while
+    // connections are dropped after timeouts or lost races of parallel ranges as well.
+    // The peer is not waited for: the socket is closed right away.
+    if (!IsSessionBroken) {
+        SSL_set_shutdown(Ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    }
+
+    SSL_free(Ssl);
+}
+
+void TTlsConnection::Send(const std::string& data) {
+    CheckConnectionIsGood();
+    ERR_clear_error();
+
+    size_t written = 0;
+    const int status = SSL_write_ex(Ssl, data.data(), data.size(), &written);
+    if (status != 1) {
+        ThrowError(status, "send");
+    }
+}
+
+int TTlsConnection::ReceiveChunk(void* result, const int estimatedSize) {
+    CheckConnectionIsGood();
+    ERR_clear_error();
+
+    size_t received = 0;
+    const int status = SSL_read_ex(Ssl, result, estimatedSize, &received);
+    if (status == 1) {
+        return received;
+    }
+
+    if (SSL_get_error(Ssl, status) == SSL_ERROR_ZERO_RETURN) {
+        return 0;
+    }
+
+    ThrowError(status, "receive");
+    return 0;
+}
+
+int TTlsConnection::PeekChunk(void* result, const int estimatedSize) {
+    CheckConnectionIsGood();
+    ERR_clear_error();
+
+    size_t peeked = 0;
+    const int status = SSL_peek_ex(Ssl, result, estimatedSize, &peeked);
+    if (status == 1) {
+        return peeked;
+    }
+
+    if (SSL_get_error(Ssl, status) == SSL_ERROR_ZERO_RETURN) {
+        return 0;
+    }
+
+    ThrowError(status, "peek");
+    return 0;
+}
+
+void TTlsConnection::Shutdown() {
+    Socket->Shutdown();
+}
+
+bool TTlsConnection::IsGood() const {
+    return Good && Socket->IsGood();
+}
+
+bool TTlsConnection::IsSessionReused() const {
+    return SSL_session_reused(Ssl) == 1;
+}
+
+bool TTlsConnection::IsKernelTlsEnabled() const {
+#ifdef BIO_get_ktls_send
+    return BIO_get_ktls_send(SSL_get_wbio(Ssl)) || BIO_get_ktls_recv(SSL_get_rbio(Ssl));
+#else
+    return false;
+#endif
+}
+
+void TTlsConnection::Handshake(const std::string& serverName) {
+    if (SSL_set_fd(Ssl, Socket->GetDescriptor()) != 1) {
+        throw TError("Cannot create TLS connection", false);
+    }
+
+    // Addresses are neither sent as SNI nor matched against DNS names.
+    unsigned char address[sizeof(struct in6_addr)];
+    const bool isAddress = inet_pton(AF_INET, serverName.c_str(), address) == 1 || inet_pton(AF_INET6, serverName.c_str(), address) == 1;
+    if (isAddress) {
+        X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(Ssl), serverName.c_str());
+    } else {
+        SSL_set_tlsext_host_name(Ssl, serverName.c_str());
+        SSL_set1_host(Ssl, serverName.c_str());
+    }
+
+    if (SSL_SESSION* session = Context->GetSession(SessionKey)) {
+        SSL_set_session(Ssl, session);
+        SSL_SESSION_free(session);
+    }
+
+    ERR_clear_error();
+
+    const int status = SSL_connect(Ssl);
+    if (status != 1) {
+        ThrowError(status, "handshake");
+    }
+
+    ++Context->HandshakeCount;
+    if (IsSessionReused()) {
+        ++Context->ResumedHandshakeCount;
+    }
+
+    if (IsKernelTlsEnabled()) {
+        ++Context->KernelTlsCount;
+    }
+}
+
+void TTlsConnection::ThrowError(const int result, const std::string& operation) {
+    Good = false;
+
+    const int error = SSL_get_error(Ssl, result);
+    if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) {
+        throw TError("Operation timed out", true);
+    }
+
+    IsSessionBroken = error == SSL_ERROR_SSL;
+
+    const long verifyResult = SSL_get_verify_result(Ssl);
+    if (verifyResult != X509_V_OK) {
+        throw TError(std::string("Cannot verify certificate: ") + X509_verify_cert_error_string(verifyResult), false);
+    }
+
+    std::string errorText;
+    {
+        errorText.append("TLS ");
+        errorText.append(operation);
+        errorText.append(" failed");
+
+        const unsigned long code = ERR_get_error();
+        if (code != 0) {
+            char description[256];
+            ERR_error_string_n(code, description, sizeof(description));
+
+            errorText.append(": ");
+            errorText.append(description);
+        }
+    }
+
+    throw TError(errorText, true);
+}
+
+void TTlsConnection::CheckConnectionIsGood() const {
+    if (!IsGood()) {
+        throw TError("Attempt to use bad connection", true);
+    }
+}
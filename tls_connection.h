@@ -0,0 +1,101 @@
+#pragma once
+
+#include "socket_connection.h"
+#include "transport.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <openssl/ssl.h>
+#include <string>
+#include <unordered_map>
+
+class TTlsOptions {
+public:
+    bool VerifyPeer = true;
+    // Certificates of trusted authorities in addition to the system ones.
+    std::string CaFile;
+};
+
+// Client TLS settings with a cache of sessions shared by all connections made
+// through the context: reconnects and parallel connections to the same server
+// resume the session instead of doing a full handshake.
+class TTlsContext {
+public:
+    explicit TTlsContext(const TTlsOptions& options = TTlsOptions());
+    ~TTlsContext();
+
+    TTlsContext(const TTlsContext&) = delete;
+    TTlsContext& operator=(const TTlsContext&) = delete;
+
+    // Context with the default options, shared by the whole process.
+    static std::shared_ptr<TTlsContext> GetDefault();
+
+    // Counted over the connections made through the context.
+    size_t GetHandshakeCount() const;
+    size_t GetResumedHandshakeCount() const;
+    size_t GetKernelTlsCount() const;
+
+private:
+    friend class TTlsConnection;
+
+    // Returns a new reference or nullptr.
+    SSL_SESSION* GetSession(const std::string& key);
+    void StoreSession(const std::string& key, SSL_SESSION* session);
+
+    static int OnNewSession(SSL* ssl, SSL_SESSION* session);
+
+private:
+    SSL_CTX* Context = nullptr;
+
+    std::mutex Mutex;
+    std::unordered_map<std::string, SSL_SESSION*> Sessions;
+
+    std::atomic<size_t> HandshakeCount{0};
+    std::atomic<size_t> ResumedHandshakeCount{0};
+    std::atomic<size_t> KernelTlsCount{0};
+};
+
+// TLS over a socket. Where the kernel supports it (kTLS) records are
+// encrypted and decrypted by the kernel after the handshake.
+class TTlsConnection : public TTransport {
+public:
+    // Sessions are resumed between connections with the same sessionKey.
+    TTlsConnection(
+            std::unique_ptr<TSocketConnection> socket,
+            const std::string& serverName,
+            const std::string& sessionKey,
+            std::shared_ptr<TTlsContext> context);
+    virtual ~TTlsConnection() override;
+
+    virtual void Send(const std::string& data) override;
+    virtual int ReceiveChunk(void* result, const int estimatedSize) override;
+    virtual int PeekChunk(void* result, const int estimatedSize) override;
+
+    virtual void Shutdown() override;
+
+    virtual bool IsGood() const override;
+
+    bool IsSessionReused() const;
+    bool IsKernelTlsEnabled() const;
+
+private:
+    friend class TTlsContext;
+
+    void Handshake(const std::string& serverName);
+
+    // Throws the error which made the operation fail.
+    void ThrowError(const int result, const std::string& operation);
+
+    void CheckConnectionIsGood() const;
+
+private:
+    const std::unique_ptr<TSocketConnection> Socket;
+    const std::shared_ptr<TTlsContext> Context;
+    const std::string SessionKey;
+
+    SSL* Ssl = nullptr;
+    bool Good = true;
+    // Set by TLS protocol failures, unlike timeouts and aborts.
+    bool IsSessionBroken = false;
+};
@@ -0,0 +1,157 @@
+#include "traffic_trace.h"
+#include "error.h"
+
+#include <algorithm>
+#include <fstream>
+
+const std::string TTrafficTrace::Signature("lruc-trace 2");
+
+std::shared_ptr<TTrafficTrace> TTrafficTrace::Create(const std::string& path) {
+    std::shared_ptr<TTrafficTrace> trace = std::make_shared<TTrafficTrace>();
+    trace->Path = path;
+    trace->Output.open(path, std::ios::binary | std::ios::trunc);
+    if (!(trace->Output << Signature << '\n')) {
+        throw TError("Cannot write trace " + path, false);
+    }
+
+    return trace;
+}
+
+std::shared_ptr<TTrafficTrace> TTrafficTrace::Load(const std::string& path) {
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        throw TError("Cannot open trace " + path, false);
+    }
+
+    std::string signature;
+    std::getline(input, signature);
+    if (signature != Signature) {
+        throw TError(path + " is not a trace", false);
+    }
+
+    std::shared_ptr<TTrafficTrace> trace = std::make_shared<TTrafficTrace>();
+    // Records of connections are interleaved, a response goes to the last request of its connection.
+    std::map<size_t, size_t> lastExchanges;
+
+    while (input.peek() != std::ifstream::traits_type::eof()) {
+        char direction = 0;
+        size_t connection = 0;
+        size_t size = 0;
+        if (!(input >> direction >> connection >> size) || input.get() != '\n') {
+            throw TError(path + " is corrupted", false);
+        }
+
+        std::string data(size, '\0');
+        if (!input.read(data.data(), size) || input.get() != '\n') {
+            throw TError(path + " is corrupted", false);
+        }
+
+        if (direction == '>') {
+            lastExchanges[connection] = trace->Exchanges.size();
+            trace->ExchangesByRequest[data].push_back(trace->Exchanges.size());
+            trace->Exchanges.push_back({std::move(data), std::string()});
+        } else if (direction == '<' && lastExchanges.count(connection)) {
+            trace->Exchanges[lastExchanges[connection]].Response.append(data);
+        } else {
+            throw TError(path + " is corrupted", false);
+        }
+    }
+
+    return trace;
+}
+
+size_t TTrafficTrace::AddConnection() {
+    std::unique_lock<std::mutex> lock(Mutex);
+    return ConnectionCount++;
+}
+
+void TTrafficTrace::AddRequest(const size_t connection, const std::string_view& request) {
+    AddRecord('>', connection, request);
+}
+
+void TTrafficTrace::AddResponse(const size_t connection, const std::string_view& response) {
+    AddRecord('<', connection, response);
+}
+
+std::string TTrafficTrace::Respond(const std::string& request) {
+    std::unique_lock<std::mutex> lock(Mutex);
+
+    const std::map<std::string, std::vector<size_t>>::const_iterator exchanges = ExchangesByRequest.find(request);
+    if (exchanges == ExchangesByRequest.end()) {
+        throw TError("Request is not in the trace: " + request.substr(0, request.find("\r\n")), false);
+    }
+
+    size_t& repliesGiven = RepliesGiven[request];
+    const size_t index = std::min(repliesGiven, exchanges->second.size() - 1);
+    ++repliesGiven;
+
+    return Exchanges[exchanges->second[index]].Response;
+}
+
+void TTrafficTrace::AddRecord(const char direction, const size_t connection, const std::string_view& data) {
+    std::unique_lock<std::mutex> lock(Mutex);
+
+    // lruc-trace 2
+    // > <connection> <request size>
+    // <request>
+    // < <connection> <response piece size>
+    // <response piece>
+    Output << direction << ' ' << connection << ' ' << data.size() << '\n';
+    Output.write(data.data(), data.size());
+    if (!(Output << '\n')) {
+        throw TError("Cannot write trace " + Path, false);
+    }
+}
+
+TRecordingTransport::TRecordingTransport(std::unique_ptr<TTransport> transport, std::shared_ptr<TTrafficTrace> trace)
+    : Transport(std::move(transport))
+    , Trace(std::move(trace))
+    , Connection(Trace->AddConnection())
+{
+}
+
+TRecordingTransport::~TRecordingTransport() {
+    try {
+        Flush();
+    } catch (...) {
+    }
+}
+
+void TRecordingTransport::Send(const std::string& data) {
+    // Requests are not pipelined: everything received since the previous request is its reply.
+    Flush();
+
+    Trace->AddRequest(Connection, data);
+    Transport->Send(data);
+}
+
+int TRecordingTransport::ReceiveChunk(void* result, const int estimatedSize) {
+    const int received = Transport->ReceiveChunk(result, estimatedSize);
+    Response.append(static_cast<const char*>(result), received);
+    if (Response.size() >= MaxResponsePieceSizeBytes) {
+        Flush();
+    }
+
+    return received;
+}
+
+int TRecordingTransport::PeekChunk(void* result, const int estimatedSize) {
+    // Peeked bytes are recorded when they are received.
+    return Transport->PeekChunk(result, estimatedSize);
+}
+
+void TRecordingTransport::Shutdown() {
+    Transport->Shutdown();
+}
+
+bool TRecordingTransport::IsGood() const {
+    return Transport->IsGood();
+}
+
+void TRecordingTransport::Flush() {
+    if (!Response.empty()) {
+        Trace->AddResponse(Connection, Response);
+    }
+
+    Response.clear();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "transport.h"
+
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Requests and the bytes received in reply to them, recorded from real
+// connections and replayed through TMemoryTransport.
+class TTrafficTrace {
+public:
+    // Recorded traffic is appended to the file as it goes rather than kept in memory.
+    static std::shared_ptr<TTrafficTrace> Create(const std::string& path);
+    static std::shared_ptr<TTrafficTrace> Load(const std::string& path);
+
+    // Returns the id to record the traffic of a new connection with.
+    size_t AddConnection();
+    void AddRequest(const size_t connection, const std::string_view& request);
+    void AddResponse(const size_t connection, const std::string_view& response);
+
+    // Returns the recorded replies to the request one by one, repeating the last one.
+    std::string Respond(const std::string& request);
+
+private:
+    class TExchange {
+    public:
+        std::string Request;
+        std::string Response;
+    };
+
+private:
+    void AddRecord(const char direction, const size_t connection, const std::string_view& data);
+
+private:
+    std::mutex Mutex;
+
+    std::string Path;
+    std::ofstream Output;
+    size_t ConnectionCount = 0;
+
+    std::vector<TExchange> Exchanges;
+    std::map<std::string, std::vector<size_t>> ExchangesByRequest;
+    std::map<std::string, size_t> RepliesGiven;
+
+    static const std::string Signature;
+};
+
+// Passes the traffic through to another transport and adds it to the trace.
+class TRecordingTransport : public TTransport {
+public:
+    TRecordingTransport(std::unique_ptr<TTransport> transport, std::shared_ptr<TTrafficTrace> trace);
+    virtual ~TRecordingTransport() override;
+
+    virtual void Send(const std::string& data) override;
+    virtual int ReceiveChunk(void* result, const int estimatedSize) override;
+    virtual int PeekChunk(void* result, const int estimatedSize) override;
+
+    virtual void Shutdown() override;
+
+    virtual bool IsGood() const override;
+
+private:
+    void Flush();
+
+private:
+    const std::unique_ptr<TTransport> Transport;
+    const std::shared_ptr<TTrafficTrace> Trace;
+    const size_t Connection;
+
+    // Received bytes are written out in pieces of this size.
+    std::string Response;
+
+    static const size_t MaxResponsePieceSizeBytes = 1 * 1024 * 1024;
+};
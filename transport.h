@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+// Byte stream THttpConnection talks HTTP over.
+class TTransport {
+public:
+    virtual ~TTransport() = default;
+
+    virtual void Send(const std::string& data) = 0;
+    // Zero means the peer has closed the stream.
+    virtual int ReceiveChunk(void* result, const int estimatedSize) = 0;
+    // Same as ReceiveChunk, but the data stays available for the next receive.
+    virtual int PeekChunk(void* result, const int estimatedSize) = 0;
+
+    // Makes blocked and further operations fail, may be called from another thread.
+    virtual void Shutdown() = 0;
+
+    virtual bool IsGood() const = 0;
+};
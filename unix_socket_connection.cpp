@@ -0,0 +1,41 @@
+#include "unix_socket_connection.h"
+#include "error.h"
+
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+TUnixSocketConnection::TUnixSocketConnection(
+        const std::string& path,
+        const std::chrono::milliseconds connectTimeout,
+        const std::chrono::milliseconds operationTimeout)
+    : TSocketConnection(connectTimeout, operationTimeout)
+{
+    Establish(path);
+}
+
+void TUnixSocketConnection::Establish(const std::string& path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw TError(path + " is too long for a socket path", false);
+    }
+
+    memcpy(address.sun_path, path.data(), path.size());
+
+    SocketDecriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (SocketDecriptor == -1) {
+        throw TError("Cannot create socket", true);
+    }
+
+    if (!Connect(reinterpret_cast<const struct sockaddr*>(&address), sizeof(address))) {
+        close(SocketDecriptor);
+        SocketDecriptor = -1;
+
+        // The sidecar may be restarting.
+        throw TError("Could not connect to " + path, true);
+    }
+}
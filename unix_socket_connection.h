@@ -0,0 +1,19 @@
+#pragma once
+
+#include "socket_connection.h"
+
+#include <chrono>
+#include <string>
+
+// Connection to a local server (a caching sidecar, for example) without going through the TCP stack.
+class TUnixSocketConnection : public TSocketConnection {
+public:
+    // Zero timeout means "wait forever".
+    TUnixSocketConnection(
+            const std::string& path,
+            const std::chrono::milliseconds connectTimeout = std::chrono::milliseconds::zero(),
+            const std::chrono::milliseconds operationTimeout = std::chrono::milliseconds::zero());
+
+private:
+    void Establish(const std::string& path);
+};